@@ -2,10 +2,176 @@
 #include "base64.h"
 #include "error.h"
 
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <map>
+#include <vector>
+
 using Caster::Authenticator;
+using Caster::CasterError;
+
+namespace
+{
+
+using Params = std::map<std::string, std::string>;
+
+bool equalsNoCase(std::string_view lhs, std::string_view rhs)
+{
+    return lhs.size() == rhs.size() &&
+           std::equal(lhs.begin(), lhs.end(), rhs.begin(), [](char l, char r) {
+               return std::tolower(static_cast<unsigned char>(l)) == std::tolower(static_cast<unsigned char>(r));
+           });
+}
+
+std::string lower(std::string_view value)
+{
+    std::string result(value);
+    std::transform(result.begin(), result.end(), result.begin(), [](char c) {
+        return static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    });
+    return result;
+}
+
+bool isTokenChar(char c)
+{
+    return std::isalnum(static_cast<unsigned char>(c)) || std::string_view("!#$%&'*+-.^_`|~").find(c) != std::string_view::npos;
+}
+
+void skipSpace(std::string_view header, size_t& pos)
+{
+    while (pos < header.size() && (header[pos] == ' ' || header[pos] == '\t'))
+        ++pos;
+}
+
+std::string_view readToken(std::string_view header, size_t& pos)
+{
+    const size_t start = pos;
+    while (pos < header.size() && isTokenChar(header[pos]))
+        ++pos;
+    return header.substr(start, pos - start);
+}
+
+std::string readValue(std::string_view header, size_t& pos)
+{
+    if (pos >= header.size() || header[pos] != '"')
+    {
+        // Token68 padding ends up here as well.
+        const size_t start = pos;
+        while (pos < header.size() && (isTokenChar(header[pos]) || header[pos] == '/' || header[pos] == '='))
+            ++pos;
+        return std::string(header.substr(start, pos - start));
+    }
+
+    std::string value;
+    for (++pos; pos < header.size() && header[pos] != '"'; ++pos)
+    {
+        if (header[pos] == '\\' && pos + 1 < header.size())
+            ++pos;
+        value += header[pos];
+    }
+    ++pos;
+    return value;
+}
+
+// Splits a header of comma separated challenges, or of bare auth-params
+// when scheme is false, into the parameters of each. Parameter names are
+// lower cased, the scheme is kept under an empty name.
+std::vector<Params> parseParams(std::string_view header, bool scheme)
+{
+    std::vector<Params> result;
+    if (!scheme)
+        result.emplace_back();
+
+    size_t pos = 0;
+    while (pos < header.size())
+    {
+        skipSpace(header, pos);
+        const std::string_view name = readToken(header, pos);
+        if (name.empty())
+        {
+            ++pos;
+            continue;
+        }
+
+        skipSpace(header, pos);
+        if (pos < header.size() && header[pos] == '=' && !result.empty())
+        {
+            ++pos;
+            skipSpace(header, pos);
+            result.back()[lower(name)] = readValue(header, pos);
+        }
+        else if (scheme)
+        {
+            result.emplace_back();
+            result.back()[""] = std::string(name);
+            // A token68 credential, as in Negotiate, ends in nothing but
+            // padding, unlike the first auth-param.
+            size_t next = pos;
+            readToken(header, next);
+            skipSpace(header, next);
+            while (next < header.size() && header[next] == '=')
+                ++next;
+            skipSpace(header, next);
+            if (next > pos && (next == header.size() || header[next] == ','))
+                pos = next;
+        }
+    }
+    return result;
+}
+
+bool listContains(std::string_view list, std::string_view item)
+{
+    size_t pos = 0;
+    while (pos < list.size())
+    {
+        skipSpace(list, pos);
+        if (equalsNoCase(readToken(list, pos), item))
+            return true;
+        while (pos < list.size() && list[pos] != ',')
+            ++pos;
+        ++pos;
+    }
+    return false;
+}
+
+std::string quoted(const std::string& value)
+{
+    std::string result("\"");
+    for (char c : value)
+    {
+        if (c == '"' || c == '\\')
+            result += '\\';
+        result += c;
+    }
+    return result + "\"";
+}
+
+std::string toHex(const unsigned char* data, size_t size)
+{
+    static const char digits[] = "0123456789abcdef";
+    std::string result;
+    result.reserve(size * 2);
+    for (size_t i = 0; i < size; ++i)
+    {
+        result += digits[data[i] >> 4];
+        result += digits[data[i] & 0x0f];
+    }
+    return result;
+}
+
+}
 
 Authenticator::Authenticator() noexcept
-    : m_authenticated(false)
+    : m_algorithm(Algorithm::md5),
+      m_nonceCount(0),
+      m_session(false),
+      m_qop(false),
+      m_userhash(false),
+      m_authenticated(false)
 {
 }
 
@@ -13,6 +179,11 @@ Authenticator::Authenticator(const std::string& login,
                              const std::string& password) noexcept
     : m_login(login),
       m_password(password),
+      m_algorithm(Algorithm::md5),
+      m_nonceCount(0),
+      m_session(false),
+      m_qop(false),
+      m_userhash(false),
       m_authenticated(true)
 {
 }
@@ -23,11 +194,113 @@ std::string Authenticator::basic() const
     return base64_encode(reinterpret_cast<const unsigned char*>(credentials.c_str()), credentials.length());
 }
 
-std::string Authenticator::digest(const std::string& /*method*/,
-                                  const std::string& /*uri*/,
-                                  const std::string& /*realm*/,
-                                  uint8_t /*qop*/,
-                                  const std::string& /*nonce*/) const
+std::string Authenticator::digest(const std::string& method,
+                                  const std::string& uri)
+{
+    if (!challenged())
+        throw CasterError("Digest authentication requires a challenge");
+
+    unsigned char random[16];
+    if (RAND_bytes(random, sizeof(random)) != 1)
+        throw CasterError("Failed to generate a Digest client nonce");
+    const std::string cnonce = toHex(random, sizeof(random));
+
+    char nc[9];
+    std::snprintf(nc, sizeof(nc), "%08x", ++m_nonceCount);
+
+    std::string ha1;
+    if (m_session)
+    {
+        if (m_sessionKey.empty())
+            m_sessionKey = hash(hash(m_login + ":" + m_realm + ":" + m_password) + ":" + m_nonce + ":" + cnonce);
+        ha1 = m_sessionKey;
+    }
+    else
+    {
+        ha1 = hash(m_login + ":" + m_realm + ":" + m_password);
+    }
+    const std::string ha2 = hash(method + ":" + uri);
+
+    // Without qop the RFC 2069 response applies.
+    const std::string response = m_qop ?
+        hash(ha1 + ":" + m_nonce + ":" + nc + ":" + cnonce + ":auth:" + ha2) :
+        hash(ha1 + ":" + m_nonce + ":" + ha2);
+
+    std::string result = "username=" + quoted(m_userhash ? hash(m_login + ":" + m_realm) : m_login) +
+                         ", realm=" + quoted(m_realm) +
+                         ", nonce=" + quoted(m_nonce) +
+                         ", uri=" + quoted(uri) +
+                         ", algorithm=" + m_algorithmName +
+                         ", response=" + quoted(response);
+    if (m_qop)
+        result += ", qop=auth, nc=" + std::string(nc) + ", cnonce=" + quoted(cnonce);
+    if (!m_opaque.empty())
+        result += ", opaque=" + quoted(m_opaque);
+    if (m_userhash)
+        result += ", userhash=true";
+    return result;
+}
+
+bool Authenticator::challenge(std::string_view header)
+{
+    for (const Params& params : parseParams(header, true))
+    {
+        const auto param = [&params](const std::string& name) {
+            const auto it = params.find(name);
+            return it != params.end() ? it->second : std::string();
+        };
+
+        if (!equalsNoCase(param(""), "Digest") || param("nonce").empty())
+            continue;
+
+        const std::string algorithm = param("algorithm").empty() ? "MD5" : param("algorithm");
+        const std::string name = lower(algorithm);
+        Algorithm digestAlgorithm;
+        if (name == "md5" || name == "md5-sess")
+            digestAlgorithm = Algorithm::md5;
+        else if (name == "sha-256" || name == "sha-256-sess")
+            digestAlgorithm = Algorithm::sha256;
+        else
+            continue;
+
+        // Only qop=auth is supported, auth-int would need the body.
+        const std::string qop = param("qop");
+        if (!qop.empty() && !listContains(qop, "auth"))
+            continue;
+
+        m_realm = param("realm");
+        m_nonce = param("nonce");
+        m_opaque = param("opaque");
+        m_algorithmName = algorithm;
+        m_algorithm = digestAlgorithm;
+        m_session = name.size() > 5 && name.compare(name.size() - 5, 5, "-sess") == 0;
+        m_qop = !qop.empty();
+        m_userhash = equalsNoCase(param("userhash"), "true");
+        m_sessionKey.clear();
+        m_nonceCount = 0;
+        return true;
+    }
+    return false;
+}
+
+void Authenticator::authenticationInfo(std::string_view header)
+{
+    const Params params = parseParams(header, false).front();
+    const auto it = params.find("nextnonce");
+    if (it == params.end() || it->second.empty() || !challenged())
+        return;
+
+    m_nonce = it->second;
+    m_sessionKey.clear();
+    m_nonceCount = 0;
+}
+
+std::string Authenticator::hash(std::string_view data) const
 {
-    throw CasterError("Digest authentication method is not implemented");
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned size = 0;
+    const EVP_MD* md = m_algorithm == Algorithm::sha256 ? EVP_sha256() : EVP_md5();
+    if (EVP_Digest(data.data(), data.size(), digest, &size, md, nullptr) != 1)
+        throw CasterError("Failed to compute a Digest hash");
+    return toHex(digest, size);
 }
@@ -2,10 +2,14 @@
 #define __CASTER_AUTHENTICATOR_H__
 
 #include <string>
+#include <string_view>
 #include <cstdint>
 
 namespace Caster {
 
+// Credentials of a connection. Basic until the caster sends a Digest
+// challenge (RFC 7616), whose nonce is then kept along with the nonce
+// count, so later requests, reconnects included, answer it right away.
 class Authenticator {
     public:
         Authenticator() noexcept;
@@ -18,18 +22,39 @@ class Authenticator {
         Authenticator& operator=(Authenticator&&) = default;
 
         std::string basic() const;
+        // Every call counts as a new use of the nonce.
         std::string digest(const std::string& method,
-                           const std::string& uri,
-                           const std::string& realm,
-                           uint8_t qop,
-                           const std::string& nonce) const;
+                           const std::string& uri);
+
+        // Takes the first supported Digest challenge of a WWW-Authenticate
+        // header, returns false if there is none.
+        bool challenge(std::string_view header);
+        // Switches to the nextnonce of an Authentication-Info header.
+        void authenticationInfo(std::string_view header);
 
         bool authenticated() const noexcept { return m_authenticated; }
+        bool challenged() const noexcept { return !m_nonce.empty(); }
+        const std::string& password() const noexcept { return m_password; }
 
     private:
+        enum class Algorithm { md5, sha256 };
+
         std::string m_login;
         std::string m_password;
+        std::string m_realm;
+        std::string m_nonce;
+        std::string m_opaque;
+        std::string m_algorithmName;
+        // H(A1) of a -sess algorithm, fixed by the first use of a nonce.
+        std::string m_sessionKey;
+        Algorithm m_algorithm;
+        uint32_t m_nonceCount;
+        bool m_session;
+        bool m_qop;
+        bool m_userhash;
         bool m_authenticated;
+
+        std::string hash(std::string_view data) const;
 };
 
 }
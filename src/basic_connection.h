@@ -0,0 +1,161 @@
+#ifndef __CASTER_BASIC_CONNECTION_H__
+#define __CASTER_BASIC_CONNECTION_H__
+
+#include "connection.h"
+#include "error.h"
+
+#include <boost/asio.hpp>
+
+#include <functional>
+
+namespace Caster {
+
+// The per read and per write part of a connection, bound at compile time
+// to the derived class: every payload slice goes to Derived::handlePayload()
+// and every completed write to Derived::handleSent(), both of which may be
+// inlined into the read and write handlers. Everything done once per
+// session lives in the Connection base.
+template <typename Derived>
+class BasicConnection : public Connection
+{
+    public:
+        using Connection::Connection;
+
+        template <typename ConstBufferSequence>
+        void send(const ConstBufferSequence& buffers);
+
+    private:
+        Derived& derived() { return static_cast<Derived&>(*this); }
+
+        void startPayload(const Slice& body) override;
+        void readData();
+        void handleReadData(const boost::system::error_code& error,
+                            size_t size);
+        void handleWriteData(const boost::system::error_code& error);
+        bool receive(const Slice& slice);
+};
+
+template <typename Derived>
+template <typename ConstBufferSequence>
+inline
+void BasicConnection<Derived>::send(const ConstBufferSequence& buffers)
+{
+    touch();
+
+    asyncWrite(
+        buffers,
+        makeAllocHandler(m_handlerMemory, std::bind(&BasicConnection::handleWriteData, this, std::placeholders::_1))
+    );
+}
+
+template <typename Derived>
+inline
+void BasicConnection<Derived>::startPayload(const Slice& body)
+{
+    if (body.size() > 0 && !receive(body))
+        return;
+    if (!handOver())
+        readData();
+}
+
+template <typename Derived>
+inline
+void BasicConnection<Derived>::readData()
+{
+    // Payload is received straight into pooled segments, so the bytes
+    // handed to the sink can be queued by the receivers without copying.
+    // The read window follows the arrival rate: a trickle gets small reads
+    // that pack many messages into one segment, bursts get reads up to a
+    // whole segment. Either way whatever arrived is forwarded at once.
+    if (!m_segment || m_segment->available() < m_readWindow)
+        m_segment = m_segments.acquire();
+
+    asyncReadSome(
+        boost::asio::buffer(m_segment->tail(), m_readWindow),
+        makeAllocHandler(
+            m_handlerMemory,
+            std::bind(
+                &BasicConnection::handleReadData,
+                this,
+                std::placeholders::_1,
+                std::placeholders::_2
+            )
+        )
+    );
+}
+
+template <typename Derived>
+inline
+void BasicConnection<Derived>::handleReadData(const boost::system::error_code& error,
+                                              size_t size)
+{
+    touch();
+
+    if (size > 0) {
+        adaptReadWindow(size);
+        if (!receive(Slice(m_segment, m_segment->commit(size))))
+            return;
+    }
+
+    if (!error) {
+        if (!handOver())
+            readData();
+    } else if (error == boost::asio::error::eof ||
+               error == boost::asio::ssl::error::stream_truncated) {
+        if (m_eofCallback)
+            m_eofCallback();
+        shutdown();
+    } else if (error != boost::asio::error::operation_aborted) {
+        reportError(error);
+        shutdown();
+    }
+}
+
+template <typename Derived>
+inline
+void BasicConnection<Derived>::handleWriteData(const boost::system::error_code& error)
+{
+    if (error)
+    {
+        if (error != boost::asio::error::operation_aborted)
+        {
+            reportError(error);
+            shutdown();
+        }
+        return;
+    }
+
+    touch();
+    derived().handleSent();
+}
+
+template <typename Derived>
+inline
+bool BasicConnection<Derived>::receive(const Slice& slice)
+{
+    if (!m_chunked) {
+        derived().handlePayload(slice);
+        return true;
+    }
+
+    // Any number of chunks may arrive with one read.
+    const ChunkDecoder::Result result = m_decoder.feed(slice, [this](const Slice& payload) {
+        derived().handlePayload(payload);
+    });
+    if (result == ChunkDecoder::finished) {
+        if (m_eofCallback)
+            m_eofCallback();
+        shutdown();
+        return false;
+    }
+    if (result == ChunkDecoder::invalid) {
+        reportError(invalidChunkLength);
+        shutdown();
+        return false;
+    }
+    return true;
+}
+
+}
+
+#endif
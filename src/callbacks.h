@@ -1,17 +1,23 @@
 #ifndef __CASTER_CALLBACKS_H__
 #define __CASTER_CALLBACKS_H__
 
+#include "segment.h"
+
 #include <boost/system/error_code.hpp>
-#include <boost/asio/buffer.hpp>
 
 #include <functional>
 
 namespace Caster {
 
 using ErrorCallback = std::function<void (const boost::system::error_code&)>;
-using DataCallback = std::function<void (const boost::asio::const_buffers_1&)>;
+using DataCallback = std::function<void (const Slice&)>;
 using EOFCallback = std::function<void ()>;
 using HeadersCallback = std::function<void ()>;
+using StopCallback = std::function<void ()>;
+// Returns true when the receiver took over reading the payload.
+using PassthroughCallback = std::function<bool ()>;
+using IdleCallback = std::function<void ()>;
+using SplicedCallback = std::function<void (size_t)>;
 
 }
 
@@ -0,0 +1,158 @@
+#ifndef __CASTER_CHUNK_DECODER_H__
+#define __CASTER_CHUNK_DECODER_H__
+
+#include "segment.h"
+
+#include <algorithm>
+#include <cstddef>
+
+namespace Caster {
+
+// Streaming decoder of HTTP chunked transfer encoding. It takes whatever a
+// read returned and hands out the payload of every chunk in it as slices of
+// the same segment; a chunk or size line split between reads is continued
+// with the next one.
+class ChunkDecoder
+{
+    public:
+        enum Result { more, finished, invalid };
+
+        ChunkDecoder() { reset(); }
+
+        void reset() { m_state = size; m_digits = 0; m_remaining = 0; m_lineSize = 0; }
+
+        template <typename Handler>
+        Result feed(const Slice& slice, Handler&& handler);
+
+    private:
+        enum State { size, extension, sizeLF, data, dataCR, dataLF, trailer, done };
+
+        // Nothing sane sends chunks this large, a longer size line is junk.
+        static const size_t maxDigits = 2 * sizeof(unsigned);
+
+        State m_state;
+        size_t m_digits;
+        size_t m_remaining;
+        size_t m_lineSize;
+
+        void startChunk();
+        static int hexValue(char c);
+};
+
+template <typename Handler>
+inline
+ChunkDecoder::Result ChunkDecoder::feed(const Slice& slice, Handler&& handler)
+{
+    const char* const bytes = slice.data();
+    size_t pos = 0;
+    while (pos < slice.size())
+    {
+        if (m_state == data)
+        {
+            const size_t chunk = std::min(m_remaining, slice.size() - pos);
+            handler(slice.sub(pos, chunk));
+            pos += chunk;
+            m_remaining -= chunk;
+            if (m_remaining == 0)
+                m_state = dataCR;
+            continue;
+        }
+
+        const char c = bytes[pos++];
+        switch (m_state)
+        {
+            case size:
+            {
+                const int value = hexValue(c);
+                if (value >= 0 && m_digits < maxDigits)
+                {
+                    m_remaining = m_remaining << 4 | static_cast<size_t>(value);
+                    ++m_digits;
+                }
+                else if (value >= 0 || m_digits == 0)
+                {
+                    return invalid;
+                }
+                else if (c == '\r')
+                {
+                    m_state = sizeLF;
+                }
+                else if (c == '\n')
+                {
+                    startChunk();
+                }
+                else
+                {
+                    m_state = extension;
+                }
+                break;
+            }
+            case extension:
+                if (c == '\n')
+                    startChunk();
+                break;
+            case sizeLF:
+                if (c != '\n')
+                    return invalid;
+                startChunk();
+                break;
+            case dataCR:
+                if (c == '\r')
+                    m_state = dataLF;
+                else if (c == '\n')
+                    m_state = size;
+                else
+                    return invalid;
+                break;
+            case dataLF:
+                if (c != '\n')
+                    return invalid;
+                m_state = size;
+                break;
+            case trailer:
+                if (c == '\n')
+                {
+                    if (m_lineSize == 0)
+                    {
+                        m_state = done;
+                        return finished;
+                    }
+                    m_lineSize = 0;
+                }
+                else if (c != '\r')
+                {
+                    ++m_lineSize;
+                }
+                break;
+            case data:
+            case done:
+                break;
+        }
+    }
+    return m_state == done ? finished : more;
+}
+
+inline
+void ChunkDecoder::startChunk()
+{
+    m_digits = 0;
+    // The last chunk has size zero, only trailer fields may follow it.
+    m_state = m_remaining == 0 ? trailer : data;
+    m_lineSize = 0;
+}
+
+inline
+int ChunkDecoder::hexValue(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+}
+
+#endif
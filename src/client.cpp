@@ -2,38 +2,27 @@
 
 #include "version.h"
 
-#include <iostream>
+#include <sstream>
 
-using Caster::Client;
-using namespace boost::asio;
-
-Client::Client(io_service& ioService,
-               const std::string& server, uint16_t port)
-    : Connection(ioService, server, port)
-{
-}
-
-Client::Client(io_service& ioService,
-               const std::string& server, uint16_t port,
-               const std::string& mountpoint)
-    : Connection(ioService, server, port, mountpoint)
+void Caster::renderClientRequest(RequestTemplate& request,
+                                 const std::string& uri, const std::string& server,
+                                 const std::string& gga)
 {
-}
+    std::ostringstream head;
+    head << "GET " << uri << " HTTP/1.1\r\n"
+         << "Host: " << server << "\r\n"
+         << "Ntrip-Version: Ntrip/2.0\r\n"
+         << "User-Agent: Boost.Asio NTRIP Client " << version
+         << "\r\n";
+    request.head = head.str();
+    request.method = "GET";
 
-void Client::prepareRequest()
-{
-    std::ostream requestStream(&m_request);
-    requestStream << "GET " << m_uri << " HTTP/1.1\r\n"
-                  << "Host: " << m_server << "\r\n"
-                  << "Ntrip-Version: Ntrip/2.0\r\n"
-                  << "User-Agent: Boost.Asio NTRIP Client " << version
-                  << "\r\n";
-    if (m_auth.authenticated())
-        requestStream << "Authorization: Basic " << m_auth.basic() << "\r\n";
-    if (!m_gga.empty())
-        requestStream << "Ntrip-GGA: " << m_gga << "\r\n";
-    requestStream << "Connection: close\r\n"
-                  << "\r\n";
-    if (!m_gga.empty())
-        requestStream << m_gga << "\r\n"; // Version 1.0
+    std::ostringstream tail;
+    if (!gga.empty())
+        tail << "Ntrip-GGA: " << gga << "\r\n";
+    tail << "Connection: close\r\n"
+         << "\r\n";
+    if (!gga.empty())
+        tail << gga << "\r\n"; // Version 1.0
+    request.tail = tail.str();
 }
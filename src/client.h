@@ -1,30 +1,82 @@
 #ifndef __CASTER_CLIENT_H__
 #define __CASTER_CLIENT_H__
 
-#include "connection.h"
-
-#include <boost/asio/io_service.hpp>
+#include "basic_connection.h"
+#include "callbacks.h"
 
 #include <string>
+#include <utility>
 #include <cstdint>
 
 namespace Caster {
 
-class Client : public Connection {
+void renderClientRequest(RequestTemplate& request,
+                         const std::string& uri, const std::string& server,
+                         const std::string& gga);
+
+// NTRIP client handing the payload to a Sink, any callable taking a Slice,
+// which is called directly from the read handler.
+template <typename Sink>
+class BasicClient : public BasicConnection<BasicClient<Sink>> {
     public:
-        Client(boost::asio::io_service& ioService,
-               const std::string& server, uint16_t port);
+        BasicClient(const Strand& strand,
+                    const std::string& server, uint16_t port,
+                    Sink sink = Sink())
+            : BasicConnection<BasicClient>(strand, server, port),
+              m_sink(std::move(sink)) {}
 
-        Client(boost::asio::io_service& ioService,
-               const std::string& server, uint16_t port,
-               const std::string& mountpoint);
+        BasicClient(const Strand& strand,
+                    const std::string& server, uint16_t port,
+                    const std::string& mountpoint,
+                    Sink sink = Sink())
+            : BasicConnection<BasicClient>(strand, server, port, mountpoint),
+              m_sink(std::move(sink)) {}
 
-        void setGGA(const std::string& gga) { m_gga = gga; }
+        void setGGA(const std::string& gga)
+        {
+            m_gga = gga;
+            this->invalidateRequest();
+        }
+
+        Sink& sink() { return m_sink; }
 
     private:
         std::string m_gga;
+        Sink m_sink;
+
+        void renderRequest(RequestTemplate& request) override
+        {
+            renderClientRequest(request, this->m_uri, this->m_server, m_gga);
+        }
+
+        void handlePayload(const Slice& slice) { m_sink(slice); }
+
+        friend class BasicConnection<BasicClient>;
+};
+
+// Sink of the runtime dispatched Client.
+class CallbackSink
+{
+    public:
+        void operator()(const Slice& slice) const
+        {
+            if (m_callback)
+                m_callback(slice);
+        }
+
+    private:
+        DataCallback m_callback;
+
+        friend class Client;
+};
+
+// Client whose payload goes to a DataCallback set at runtime.
+class Client : public BasicClient<CallbackSink> {
+    public:
+        using BasicClient::BasicClient;
 
-        void prepareRequest() override;
+        void setDataCallback(const DataCallback& cb) { sink().m_callback = cb; }
+        void resetDataCallback() { sink().m_callback = {}; }
 };
 
 }
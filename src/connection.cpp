@@ -2,9 +2,11 @@
 
 #include "error.h"
 #include "logger.h"
-#include "utils.h"
 
-#include <boost/lexical_cast.hpp>
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <string_view>
 
 #define ERRLOG(level) LOG(CerrWriter, level)
 
@@ -18,64 +20,99 @@ namespace ba = boost::asio;
 namespace
 {
 
-using StringPair = std::pair<std::string, std::string>;
-
-StringPair splitString(const std::string& src, char delimiter)
-{
-    const size_t pos = src.find_first_of(delimiter);
-    if (pos != std::string::npos)
-        return std::make_pair(src.substr(0, pos), src.substr(pos + 1));
-
-    return std::make_pair(src, "");
-}
-
-StringPair trimStringPair(const StringPair& pair)
+bool equalsNoCase(std::string_view lhs, std::string_view rhs)
 {
-    const size_t lpos = pair.second.find_first_not_of(" \t");
-    const size_t rpos = pair.second.find_last_not_of(" \t\r\n", std::string::npos, 4);
-    return std::make_pair(pair.first, pair.second.substr(lpos, rpos - lpos + 1));
+    return lhs.size() == rhs.size() &&
+           std::equal(lhs.begin(), lhs.end(), rhs.begin(), [](char l, char r) {
+               return std::tolower(static_cast<unsigned char>(l)) == std::tolower(static_cast<unsigned char>(r));
+           });
 }
 
 }
 
-Connection::Connection(ba::io_service& ioService,
+Connection::Connection(const Strand& strand,
                        const std::string& server, uint16_t port)
     : m_server(server),
       m_port(port),
       m_uri("/"),
       m_timeout(0),
-      m_socket(ioService),
-      m_timeouter(ioService),
-      m_resolver(ioService),
-      m_response(1024),
+      m_socket(strand),
+      m_session(0),
+      m_connector(strand),
+      m_segments(16 * 1024, 8),
+      m_responseStart(0),
+      m_readWindow(minReadWindow),
+      m_shortReads(0),
+      m_requestRendered(false),
+      m_useTls(false),
       m_chunked(false),
-      m_active(false)
+      m_active(false),
+      m_challenged(false),
+      m_authRetried(false)
 {
 }
 
-Connection::Connection(ba::io_service& ioService,
+Connection::Connection(const Strand& strand,
                        const std::string& server, uint16_t port,
                        const std::string& mountpoint)
     : m_server(server),
       m_port(port),
       m_timeout(0),
-      m_socket(ioService),
-      m_timeouter(ioService),
-      m_resolver(ioService),
-      m_response(1024),
+      m_socket(strand),
+      m_session(0),
+      m_connector(strand),
+      m_segments(16 * 1024, 8),
+      m_responseStart(0),
+      m_readWindow(minReadWindow),
+      m_shortReads(0),
+      m_requestRendered(false),
+      m_useTls(false),
       m_chunked(false),
-      m_active(false)
+      m_active(false),
+      m_challenged(false),
+      m_authRetried(false)
 {
     if (mountpoint[0] != '/')
         m_uri = "/";
     m_uri += mountpoint;
 }
 
+Connection::~Connection()
+{
+    if (m_timeoutEntry)
+        ba::use_service<TimingWheel>(m_socket.get_executor().context()).cancel(m_timeoutEntry);
+}
+
 void Connection::start()
 {
-    m_resolver.async_resolve(tcp::resolver::query(m_server, boost::lexical_cast<std::string>(m_port)),
-                             std::bind(&Connection::handleResolve, this, pls::_1, pls::_2));
-    restartTimer();
+    m_authRetried = false;
+    open();
+}
+
+void Connection::open()
+{
+    // A restarted connection keeps its buffers but nothing of the previous
+    // session.
+    m_active = false;
+    m_chunked = false;
+    m_headers.clear();
+    resetSession();
+
+    if (m_timeout > 0 && !m_timeoutEntry)
+    {
+        m_timeoutEntry = ba::use_service<TimingWheel>(m_socket.get_executor().context()).schedule(
+            m_socket.get_executor(),
+            m_timeout,
+            std::bind(&Connection::handleTimeout, this)
+        );
+    }
+
+    ResolverCache::getInstance().resolve(
+        m_socket.get_executor(),
+        m_server,
+        m_port,
+        std::bind(&Connection::handleResolve, this, ++m_session, pls::_1, pls::_2)
+    );
 }
 
 void Connection::start(unsigned timeout)
@@ -88,11 +125,17 @@ void Connection::setCredentials(const std::string& login,
                                 const std::string& password)
 {
     m_auth = Authenticator(login, password);
+    invalidateRequest();
 }
 
-void Connection::handleResolve(const bs::error_code& error,
-                               tcp::resolver::iterator it)
+void Connection::handleResolve(unsigned session,
+                               const bs::error_code& error,
+                               const ResolverCache::Results& results)
 {
+    // The lookup can not be cancelled, it may complete after a shutdown.
+    if (session != m_session)
+        return;
+
     if (error)
     {
         reportError(error);
@@ -100,7 +143,7 @@ void Connection::handleResolve(const bs::error_code& error,
         return;
     }
 
-    if (it == tcp::resolver::iterator())
+    if (results.empty())
     {
         reportError(resolveError);
         shutdown();
@@ -108,58 +151,91 @@ void Connection::handleResolve(const bs::error_code& error,
     }
 
     ERRLOG(logDebug) << "Endpoints to connect:";
-    for (auto i = it; i != tcp::resolver::iterator(); ++i)
-        ERRLOG(logDebug) << i->endpoint();
+    for (const auto& entry : results)
+        ERRLOG(logDebug) << entry.endpoint();
 
-    restartTimer();
-    ERRLOG(logDebug) << "Trying to connect to " << it->endpoint();
-    m_socket.async_connect(*it, std::bind(&Connection::handleConnect, this, pls::_1, it));
+    touch();
+    m_connector.connect(results, m_socket, std::bind(&Connection::handleConnect, this, pls::_1));
 }
 
-void Connection::handleConnect(const bs::error_code& error,
-                               tcp::resolver::iterator it)
+void Connection::handleConnect(const bs::error_code& error)
 {
     if (error)
     {
-        ERRLOG(logDebug) << "Error connecting to " << it->endpoint() << ": " << error.message();
-        ++it;
-        ERRLOG(logDebug) << "Trying to connect to " << it->endpoint();
-        if (it == tcp::resolver::iterator())
-        {
-            reportError(error);
-            shutdown();
-            return;
-        }
-        restartTimer();
-        m_socket.close();
-        m_socket.async_connect(*it, std::bind(&Connection::handleConnect, this, pls::_1, it));
+        reportError(error);
+        shutdown();
         return;
     }
 
     ERRLOG(logDebug) << "Successfully connected to " << m_socket.remote_endpoint();
 
-    restartTimer();
-    prepareRequest();
-    ba::async_write(m_socket, m_request, ba::transfer_all(), std::bind(&Connection::handleWriteRequest, this, pls::_1));
+    if (!m_socketProfile.empty()) {
+        bs::error_code ec;
+        applySocketProfile(m_socket.native_handle(), m_socketProfile, ec);
+        if (ec) {
+            ERRLOG(logWarning) << "Failed to apply socket profile: " << ec.message();
+        }
+    }
+
+    touch();
+    if (!m_useTls)
+    {
+        m_tls.reset();
+        writeRequest();
+        return;
+    }
+
+    m_tls = std::make_unique<TlsStream>(m_socket, TlsContext::getInstance().context());
+    TlsContext::getInstance().prepare(*m_tls, m_server, m_port);
+    m_tls->async_handshake(
+        ba::ssl::stream_base::client,
+        makeAllocHandler(m_handlerMemory, std::bind(&Connection::handleHandshake, this, pls::_1))
+    );
 }
 
-void Connection::handleWriteRequest(const bs::error_code& error)
+void Connection::handleHandshake(const bs::error_code& error)
 {
     if (error)
     {
         if (error != ba::error::operation_aborted)
         {
+            ERRLOG(logError) << "TLS handshake with " << m_server << " failed: " << error.message();
             reportError(error);
             shutdown();
         }
         return;
     }
 
-    restartTimer();
-    ba::async_read_until(m_socket, m_response, "\r\n", std::bind(&Connection::handleReadStatus, this, pls::_1));
+    ERRLOG(logDebug) << "TLS session " << (SSL_session_reused(m_tls->native_handle()) ? "resumed" : "established")
+                     << " with " << m_server;
+    touch();
+    writeRequest();
 }
 
-void Connection::handleWriteData(const bs::error_code& error)
+void Connection::writeRequest()
+{
+    if (!m_requestRendered)
+    {
+        m_requestTemplate = RequestTemplate();
+        renderRequest(m_requestTemplate);
+        m_authorization.clear();
+        if (!m_requestTemplate.method.empty() && m_auth.authenticated())
+            m_authorization = "Authorization: Basic " + m_auth.basic() + "\r\n";
+        m_requestRendered = true;
+    }
+    if (!m_requestTemplate.method.empty() && m_auth.challenged())
+        m_authorization = "Authorization: Digest " + m_auth.digest(m_requestTemplate.method, m_uri) + "\r\n";
+
+    const std::array<ba::const_buffer, 3> request = {
+        ba::buffer(m_requestTemplate.head),
+        ba::buffer(m_authorization),
+        ba::buffer(m_requestTemplate.tail)
+    };
+    asyncWrite(request,
+               makeAllocHandler(m_handlerMemory, std::bind(&Connection::handleWriteRequest, this, pls::_1)));
+}
+
+void Connection::handleWriteRequest(const bs::error_code& error)
 {
     if (error)
     {
@@ -171,261 +247,169 @@ void Connection::handleWriteData(const bs::error_code& error)
         return;
     }
 
-    restartTimer();
+    touch();
+    // The reply head is received into a fresh segment and parsed in place,
+    // so the payload following it is delivered without copying.
+    m_parser.reset();
+    m_decoder.reset();
+    m_challenged = false;
+    m_segment = m_segments.acquire();
+    m_responseStart = m_segment->size();
+    readResponse();
 }
 
-void Connection::handleReadStatus(const bs::error_code& error)
+void Connection::readResponse()
 {
-    restartTimer();
-    if (!error) {
-        std::istream statusStream(&m_response);
-        std::string proto;
-        statusStream >> proto;
-        unsigned code;
-        statusStream >> code;
-        std::string message;
-        std::getline(statusStream, message);
-        if (code != 200) {
-            ERRLOG(logError) << "Invalid status string:\n"
-                          << proto << " " << code << " " << message;
-            reportError(invalidStatus);
-            shutdown();
-            return;
-        }
-        if (proto == "ICY") {
-            m_active = true;
-            ba::async_read(
-                m_socket,
-                m_response,
-                std::bind(
-                    &Connection::handleReadData,
-                    this,
-                    pls::_1
-                )
-            );
-        } else {
-            ba::async_read_until(
-                m_socket,
-                m_response,
-                "\r\n\r\n",
-                std::bind(
-                    &Connection::handleReadHeaders,
-                    this,
-                    pls::_1
-                )
-            );
-        }
-    } else if (error != ba::error::operation_aborted) {
-        reportError(error);
-        shutdown();
-    }
+    asyncReadSome(
+        m_segment->tail(),
+        makeAllocHandler(
+            m_handlerMemory,
+            std::bind(
+                &Connection::handleReadResponse,
+                this,
+                pls::_1,
+                pls::_2
+            )
+        )
+    );
 }
 
-void Connection::handleReadHeaders(const bs::error_code& error)
+void Connection::handleReadResponse(const bs::error_code& error,
+                                    size_t size)
 {
-    restartTimer();
-    if (!error) {
-        std::istream headersStream(&m_response);
-        std::string header;
-        while (std::getline(headersStream, header) && header != "\r") {
-            const StringPair pair(trimStringPair(splitString(header, ':')));
-            m_headers.insert(pair);
-            if (pair.first == "Transfer-Encoding" &&
-                pair.second == "chunked") {
-                ERRLOG(logDebug) << "Transfer-Encoding: chunked";
-                m_chunked = true;
-            }
-        }
-        if (m_headersCallback)
-            m_headersCallback();
-        m_active = true;
-        if (m_chunked) {
-            ba::async_read_until(
-                m_socket,
-                m_response,
-                "\r\n",
-                std::bind(
-                    &Connection::handleReadChunkLength,
-                    this,
-                    pls::_1
-                )
-            );
-        } else {
-            ba::async_read(
-                m_socket,
-                m_response,
-                std::bind(
-                    &Connection::handleReadData,
-                    this,
-                    pls::_1
-                )
-            );
+    touch();
+    if (error) {
+        if (error != ba::error::operation_aborted) {
+            reportError(error);
+            shutdown();
         }
-    } else if (error != ba::error::operation_aborted) {
-        reportError(error);
-        shutdown();
+        return;
     }
-}
 
-void Connection::handleReadData(const bs::error_code& error)
-{
-    restartTimer();
-
-    if (m_response.size() > 0) {
-        if (m_dataCallback)
-            m_dataCallback(m_response.data());
-        m_response.consume(m_response.size());
+    m_segment->commit(size);
+    const std::string_view data(m_segment->data() + m_responseStart,
+                                m_segment->size() - m_responseStart);
+    for (;;) {
+        switch (m_parser.parse(data)) {
+            case ResponseParser::incomplete:
+                if (m_segment->available() == 0) {
+                    reportError(responseTooLarge);
+                    shutdown();
+                } else {
+                    readResponse();
+                }
+                return;
+            case ResponseParser::invalid:
+                ERRLOG(logError) << "Invalid response:\n" << data.substr(0, m_parser.consumed());
+                reportError(invalidStatus);
+                shutdown();
+                return;
+            case ResponseParser::header:
+                m_headers.emplace(m_parser.name(), m_parser.value());
+                if (equalsNoCase(m_parser.name(), "Transfer-Encoding") &&
+                    equalsNoCase(m_parser.value(), "chunked")) {
+                    ERRLOG(logDebug) << "Transfer-Encoding: chunked";
+                    m_chunked = true;
+                } else if (m_auth.authenticated() && !m_challenged &&
+                           equalsNoCase(m_parser.name(), "WWW-Authenticate")) {
+                    m_challenged = m_auth.challenge(m_parser.value());
+                } else if (equalsNoCase(m_parser.name(), "Authentication-Info")) {
+                    m_auth.authenticationInfo(m_parser.value());
+                }
+                continue;
+            case ResponseParser::complete:
+                break;
+        }
+        break;
     }
 
-    if (!error) {
-        ba::async_read(
-            m_socket,
-            m_response,
-            ba::transfer_at_least(1),
-            std::bind(
-                &Connection::handleReadData,
-                this,
-                pls::_1
-            )
-        );
-    } else if (error == ba::error::eof) {
-        if (m_eofCallback)
-            m_eofCallback();
+    // A stale or first seen nonce costs one more round trip, which the
+    // caster most likely expects on a new connection.
+    if (m_parser.code() == 401 && m_challenged && !m_authRetried) {
+        ERRLOG(logInfo) << "Digest challenge from " << m_server << ", authenticating again";
+        m_authRetried = true;
         shutdown();
-    } else if (error != ba::error::operation_aborted) {
-        reportError(error);
+        open();
+        return;
+    }
+
+    if (m_parser.code() != 200) {
+        ERRLOG(logError) << "Invalid status string:\n" << m_parser.statusLine();
+        reportError(invalidStatus);
         shutdown();
+        return;
     }
+
+    if (!m_parser.isIcy() && m_headersCallback)
+        m_headersCallback();
+    m_active = true;
+
+    const ba::const_buffer body(data.data() + m_parser.consumed(),
+                                data.size() - m_parser.consumed());
+    startPayload(Slice(m_segment, body));
 }
 
-void Connection::handleReadChunkLength(const bs::error_code& error)
+void Connection::adaptReadWindow(size_t size)
 {
-    restartTimer();
-
-    if (!error) {
-        size_t length = 0;
-        m_response.consume(parseChunkLength(m_response.data(), length));
-        if (length == 0) {
-            if (m_eofCallback)
-                m_eofCallback();
-            shutdown();
-        } else {
-            if (m_response.size() < length + 2) {
-                ba::async_read(
-                    m_socket,
-                    m_response,
-                    ba::transfer_at_least(length + 2 - m_response.size()),
-                    std::bind(
-                        &Connection::handleReadChunkData,
-                        this,
-                        pls::_1,
-                        length
-                    )
-                );
-            } else {
-                handleReadChunkData(bs::error_code(), length);
-            }
+    if (size == m_readWindow) {
+        m_readWindow = std::min(m_readWindow * 2, m_segments.segmentSize());
+        m_shortReads = 0;
+    } else if (size < m_readWindow / 4) {
+        // Shrink only after a run of short reads, single quiet moments
+        // between bursts are common.
+        if (++m_shortReads == shortReadsToShrink) {
+            m_readWindow = std::max(m_readWindow / 2, minReadWindow);
+            m_shortReads = 0;
         }
-    } else if (error == ba::error::eof) {
-        if (m_eofCallback)
-            m_eofCallback();
-        shutdown();
-    } else if (error != ba::error::operation_aborted) {
-        reportError(error);
-        shutdown();
+    } else {
+        m_shortReads = 0;
     }
 }
 
-void Connection::handleReadChunkData(const bs::error_code& error,
-                                       size_t size)
+bool Connection::handOver()
 {
-    restartTimer();
-
-    if (size > 0) {
-        if (size > m_response.size()) {
-            if (m_dataCallback)
-                m_dataCallback(m_response.data());
-        } else {
-            if (m_dataCallback)
-                m_dataCallback(buffer(m_response.data(), size));
-        }
-    }
-    if (!error) {
-        if (size > m_response.size()) {
-            const size_t remainder = size + 2 - m_response.size();
-            m_response.consume(m_response.size());
-            ba::async_read(
-                m_socket,
-                m_response,
-                ba::transfer_at_least(remainder),
-                std::bind(
-                    &Connection::handleReadChunkData,
-                    this,
-                    pls::_1,
-                    remainder - 2
-                )
-            );
-        } else {
-            m_response.consume(size + 2);
-            ba::async_read_until(
-                m_socket,
-                m_response,
-                "\r\n",
-                std::bind(
-                    &Connection::handleReadChunkLength,
-                    this,
-                    pls::_1
-                )
-            );
-        }
-    } else if (error == ba::error::eof) {
-        if (m_eofCallback)
-            m_eofCallback();
-        shutdown();
-    } else if (error != ba::error::operation_aborted) {
-        reportError(error);
-        shutdown();
-    }
+    // Unframed payload may be moved by the receiver on its own, e.g. with
+    // splice(), once it is ready to take it.
+    return !m_chunked && m_passthroughCallback && m_passthroughCallback();
 }
 
 void Connection::shutdown()
 {
     m_active = false;
+    ++m_session;
+    m_connector.cancel();
+    if (m_timeoutEntry)
+    {
+        ba::use_service<TimingWheel>(m_socket.get_executor().context()).cancel(m_timeoutEntry);
+        m_timeoutEntry.reset();
+    }
     if (!m_socket.is_open())
         return;
     ERRLOG(logDebug) << "Connection::shutdown()";
+    if (m_tls)
+    {
+        // Casters tend to close without close_notify. The session would be
+        // given up as truncated when freed, marking it shut down keeps it
+        // resumable.
+        SSL_set_quiet_shutdown(m_tls->native_handle(), 1);
+        SSL_set_shutdown(m_tls->native_handle(), SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+    }
     bs::error_code ec;
     m_socket.shutdown(tcp::socket::shutdown_both, ec);
     m_socket.close(ec);
 }
 
-void Connection::handleTimeout(const bs::error_code& ec)
+void Connection::handleTimeout()
 {
-    if (ec == ba::error::operation_aborted)
-        return;
+    m_timeoutEntry.reset();
     if (!m_socket.is_open())
         return;
 
-    // Check whether the deadline has passed. We compare the deadline against
-    // the current time since a new asynchronous operation may have moved the
-    // deadline before this actor had a chance to run.
-    if (m_timeouter.expires_at() > std::chrono::steady_clock::now())
-        m_timeouter.async_wait(std::bind(&Connection::handleTimeout, this, pls::_1));
-
-    ERRLOG(logInfo) << "Connection timeout detected, shutting it down" << std::endl;
+    ERRLOG(logInfo) << "Connection timeout detected, shutting it down";
     reportError(connectionTimeout);
     shutdown();
 }
 
-void Connection::restartTimer()
-{
-    if (m_timeout > 0)
-        return;
-
-    m_timeouter.expires_from_now(std::chrono::seconds(m_timeout));
-    m_timeouter.async_wait(std::bind(&Connection::handleTimeout, this, pls::_1));
-}
-
 void Connection::reportError(const bs::error_code& ec)
 {
     if (m_errorCallback)
@@ -3,6 +3,16 @@
 
 #include "authenticator.h"
 #include "callbacks.h"
+#include "chunk_decoder.h"
+#include "connector.h"
+#include "handler_memory.h"
+#include "resolver_cache.h"
+#include "response_parser.h"
+#include "segment.h"
+#include "socket_profile.h"
+#include "strand.h"
+#include "timing_wheel.h"
+#include "tls_context.h"
 
 #include <boost/asio.hpp>
 
@@ -10,46 +20,65 @@
 #include <vector>
 #include <map>
 #include <functional>
+#include <memory>
 #include <chrono>
 #include <cstdint>
 
 namespace Caster
 {
 
+// A request rendered once, split around its Authorization header.
+struct RequestTemplate
+{
+    std::string head;
+    // Method the credentials are for, none without an Authorization header.
+    std::string method;
+    std::string tail;
+};
+
+// Session setup of a caster connection: lookup, connect, request and reply
+// head. Reading the payload and writing data is up to BasicConnection.
 class Connection
 {
     public:
-        Connection(boost::asio::io_service& ioService,
+        using Socket = StrandSocket;
+
+        Connection(const Strand& strand,
                    const std::string& server, uint16_t port);
 
-        Connection(boost::asio::io_service& ioService,
+        Connection(const Strand& strand,
                    const std::string& server, uint16_t port,
                    const std::string& mountpoint);
-        virtual ~Connection() = default;
+        virtual ~Connection();
 
         void start();
         void start(unsigned timeout);
         void stop() { shutdown(); }
 
-        template <typename ConstBufferSequence>
-        void send(const ConstBufferSequence& buffers);
-
         void setCredentials(const std::string& login,
                             const std::string& password);
+        void setSocketProfile(const SocketProfile& profile) { m_socketProfile = profile; }
+        // Speaks TLS to the caster from the next start() on.
+        void setTls(bool tls) { m_useTls = tls; }
+        bool tls() const { return m_useTls; }
 
         void setErrorCallback(const ErrorCallback& cb) { m_errorCallback = cb; }
-        void setDataCallback(const DataCallback& cb) { m_dataCallback = cb; }
         void setEOFCallback(const EOFCallback& cb) { m_eofCallback = cb; }
         void setHeadersCallback(const HeadersCallback& cb) { m_headersCallback = cb; }
+        void setPassthroughCallback(const PassthroughCallback& cb) { m_passthroughCallback = cb; }
 
         void resetErrorCallback() { m_errorCallback = {}; }
-        void resetDataCallback() { m_dataCallback = {}; }
         void resetEOFCallback() { m_eofCallback = {}; }
         void resetHeadersCallback() { m_headersCallback = {}; }
+        void resetPassthroughCallback() { m_passthroughCallback = {}; }
 
         const std::map<std::string, std::string>& headers() const { return m_headers; }
 
         bool isActive() const { return m_active; }
+        // Counts as activity for the connection timeout.
+        void touch() { if (m_timeoutEntry) m_timeoutEntry->touch(); }
+
+        Socket& socket() { return m_socket; }
 
     protected:
         using tcp = boost::asio::ip::tcp;
@@ -58,59 +87,111 @@ class Connection
         uint16_t m_port;
         std::string m_uri;
         Authenticator m_auth;
+        SocketProfile m_socketProfile;
         unsigned m_timeout;
         std::map<std::string, std::string> m_headers;
-        tcp::socket m_socket;
-        boost::asio::steady_timer m_timeouter;
-        boost::asio::streambuf m_request;
+        // Must outlive the socket, which frees the operations it still has.
+        HandlerMemory m_handlerMemory;
+        Socket m_socket;
+        TimingWheel::EntryPtr m_timeoutEntry;
+
+        // The request is rendered once and reused by every session until
+        // invalidateRequest(), only Digest credentials are made per request.
+        virtual void renderRequest(RequestTemplate& request) = 0;
+        void invalidateRequest() { m_requestRendered = false; }
+        // Takes over once the reply head was accepted, with the payload
+        // received along with it.
+        virtual void startPayload(const Slice& body) = 0;
+        // Called by start(), so a reused connection forgets its last session.
+        virtual void resetSession() {}
+
+        void shutdown();
 
-        virtual void prepareRequest() = 0;
+        void reportError(const boost::system::error_code& ec);
+        void reportError(int val);
+
+        template <typename MutableBufferSequence, typename Handler>
+        void asyncReadSome(const MutableBufferSequence& buffers, Handler handler);
+        template <typename ConstBufferSequence, typename Handler>
+        void asyncWrite(const ConstBufferSequence& buffers, Handler handler);
 
     private:
-        tcp::resolver m_resolver;
-        boost::asio::streambuf m_response;
+        static constexpr size_t minReadWindow = 256;
+        static constexpr unsigned shortReadsToShrink = 8;
+
+        unsigned m_session;
+        Connector m_connector;
+        SegmentPool m_segments;
+        SegmentPtr m_segment;
+        ResponseParser m_parser;
+        ChunkDecoder m_decoder;
+        size_t m_responseStart;
+        size_t m_readWindow;
+        unsigned m_shortReads;
         ErrorCallback m_errorCallback;
-        DataCallback m_dataCallback;
         EOFCallback m_eofCallback;
         HeadersCallback m_headersCallback;
+        PassthroughCallback m_passthroughCallback;
+        // Made anew for every session, but kept until the next one since
+        // aborted operations still refer to it.
+        std::unique_ptr<TlsStream> m_tls;
+        std::vector<char> m_tlsBuffer;
+        RequestTemplate m_requestTemplate;
+        std::string m_authorization;
+        bool m_requestRendered;
+        bool m_useTls;
         bool m_chunked;
         bool m_active;
-
-        void handleResolve(const boost::system::error_code& error,
-                           tcp::resolver::iterator it);
-        void handleConnect(const boost::system::error_code& error,
-                           tcp::resolver::iterator it);
+        // A Digest challenge came with the reply, and was answered already
+        // since start().
+        bool m_challenged;
+        bool m_authRetried;
+
+        void open();
+        void handleResolve(unsigned session,
+                           const boost::system::error_code& error,
+                           const ResolverCache::Results& results);
+        void handleConnect(const boost::system::error_code& error);
+        void handleHandshake(const boost::system::error_code& error);
+        void writeRequest();
         void handleWriteRequest(const boost::system::error_code& error);
-        void handleWriteData(const boost::system::error_code& error);
-        void handleReadStatus(const boost::system::error_code& error);
-        void handleReadHeaders(const boost::system::error_code& error);
-        void handleReadData(const boost::system::error_code& error);
-        void handleReadChunkLength(const boost::system::error_code& error);
-        void handleReadChunkData(const boost::system::error_code& error,
-                                 size_t size);
+        void handleReadResponse(const boost::system::error_code& error,
+                                size_t size);
 
-        void shutdown();
+        void readResponse();
+        void adaptReadWindow(size_t size);
+        bool handOver();
 
-        void restartTimer();
-        void handleTimeout(const boost::system::error_code& ec);
+        void handleTimeout();
 
-        void reportError(const boost::system::error_code& ec);
-        void reportError(int val);
+        template <typename> friend class BasicConnection;
 };
 
-template <typename ConstBufferSequence>
+template <typename MutableBufferSequence, typename Handler>
+inline
+void Connection::asyncReadSome(const MutableBufferSequence& buffers, Handler handler)
+{
+    if (m_tls)
+        m_tls->async_read_some(buffers, std::move(handler));
+    else
+        m_socket.async_read_some(buffers, std::move(handler));
+}
+
+template <typename ConstBufferSequence, typename Handler>
 inline
-void Connection::send(const ConstBufferSequence& buffers)
+void Connection::asyncWrite(const ConstBufferSequence& buffers, Handler handler)
 {
-    if (m_timeout)
-        m_timeouter.expires_from_now(std::chrono::seconds(m_timeout));
-
-    async_write(
-        m_socket,
-        buffers,
-        boost::asio::transfer_all(),
-        std::bind(&Connection::handleWriteData, this, std::placeholders::_1)
-    );
+    if (!m_tls)
+    {
+        boost::asio::async_write(m_socket, buffers, boost::asio::transfer_all(), std::move(handler));
+        return;
+    }
+
+    // The TLS stream seals every buffer of a sequence into a record of its
+    // own, a gather write is sent as one record instead.
+    m_tlsBuffer.resize(boost::asio::buffer_size(buffers));
+    boost::asio::buffer_copy(boost::asio::buffer(m_tlsBuffer), buffers);
+    boost::asio::async_write(*m_tls, boost::asio::buffer(m_tlsBuffer), boost::asio::transfer_all(), std::move(handler));
 }
 
 }
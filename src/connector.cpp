@@ -0,0 +1,127 @@
+#include "connector.h"
+
+#include "logger.h"
+
+#include <utility>
+
+#define ERRLOG(level) LOG(CerrWriter, level)
+
+using namespace MADF;
+using Caster::Connector;
+
+namespace pls = std::placeholders;
+namespace bs = boost::system;
+namespace ba = boost::asio;
+
+Connector::Connector(const Strand& strand)
+    : m_strand(strand),
+      m_timer(strand),
+      m_next(0),
+      m_failed(0),
+      m_generation(0),
+      m_target(nullptr)
+{
+}
+
+void Connector::connect(const ResolverCache::Results& results,
+                        StrandSocket& target,
+                        const Handler& handler)
+{
+    cancel();
+    m_target = &target;
+    m_handler = handler;
+    m_next = 0;
+    m_failed = 0;
+
+    // Alternate address families, starting with the preferred first one.
+    std::vector<ba::ip::tcp::endpoint> preferred;
+    std::vector<ba::ip::tcp::endpoint> other;
+    for (const auto& entry : results)
+    {
+        if (preferred.empty() || entry.endpoint().protocol() == preferred.front().protocol())
+            preferred.push_back(entry.endpoint());
+        else
+            other.push_back(entry.endpoint());
+    }
+    m_endpoints.clear();
+    for (size_t i = 0; i < preferred.size() || i < other.size(); ++i)
+    {
+        if (i < preferred.size())
+            m_endpoints.push_back(preferred[i]);
+        if (i < other.size())
+            m_endpoints.push_back(other[i]);
+    }
+
+    startAttempt();
+}
+
+void Connector::cancel()
+{
+    ++m_generation;
+    m_timer.cancel();
+    m_attempts.clear();
+    m_handler = {};
+}
+
+void Connector::startAttempt()
+{
+    const size_t index = m_next++;
+    ERRLOG(logDebug) << "Trying to connect to " << m_endpoints[index];
+    m_attempts.push_back(std::make_unique<StrandSocket>(m_strand));
+    m_attempts.back()->async_connect(
+        m_endpoints[index],
+        std::bind(&Connector::handleAttempt, this, m_generation, index, pls::_1)
+    );
+
+    if (m_next < m_endpoints.size())
+    {
+        m_timer.expires_after(attemptDelay);
+        m_timer.async_wait(std::bind(&Connector::handleDelay, this, m_generation, pls::_1));
+    }
+}
+
+void Connector::handleAttempt(unsigned generation, size_t index,
+                              const bs::error_code& error)
+{
+    if (generation != m_generation || error == ba::error::operation_aborted)
+        return;
+
+    if (error)
+    {
+        ERRLOG(logDebug) << "Error connecting to " << m_endpoints[index] << ": " << error.message();
+        bs::error_code ec;
+        m_attempts[index]->close(ec);
+        ++m_failed;
+        if (m_next < m_endpoints.size())
+        {
+            m_timer.cancel();
+            startAttempt();
+        }
+        else if (m_failed == m_endpoints.size())
+        {
+            finish(error);
+        }
+        return;
+    }
+
+    *m_target = std::move(*m_attempts[index]);
+    finish(error);
+}
+
+void Connector::handleDelay(unsigned generation,
+                            const bs::error_code& error)
+{
+    if (error || generation != m_generation)
+        return;
+    if (m_next < m_endpoints.size())
+        startAttempt();
+}
+
+void Connector::finish(const bs::error_code& error)
+{
+    Handler handler;
+    std::swap(handler, m_handler);
+    cancel();
+    if (handler)
+        handler(error);
+}
@@ -0,0 +1,58 @@
+#ifndef __CASTER_CONNECTOR_H__
+#define __CASTER_CONNECTOR_H__
+
+#include "resolver_cache.h"
+#include "strand.h"
+
+#include <boost/asio.hpp>
+#include <boost/system/error_code.hpp>
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace Caster {
+
+// Connects to the first reachable of the resolved endpoints the RFC 8305
+// (Happy Eyeballs) way: address families are interleaved and a new attempt
+// starts every 250 ms, or as soon as the previous one failed, while the
+// earlier ones keep going. The first established connection is moved into
+// the target socket and the rest are closed, so a dead address costs a
+// quarter of a second instead of a TCP timeout.
+class Connector
+{
+    public:
+        using Handler = std::function<void (const boost::system::error_code&)>;
+
+        explicit Connector(const Strand& strand);
+
+        void connect(const ResolverCache::Results& results,
+                     StrandSocket& target,
+                     const Handler& handler);
+        void cancel();
+
+    private:
+        static constexpr std::chrono::milliseconds attemptDelay{250};
+
+        Strand m_strand;
+        StrandTimer m_timer;
+        std::vector<boost::asio::ip::tcp::endpoint> m_endpoints;
+        std::vector<std::unique_ptr<StrandSocket>> m_attempts;
+        size_t m_next;
+        size_t m_failed;
+        unsigned m_generation;
+        StrandSocket* m_target;
+        Handler m_handler;
+
+        void startAttempt();
+        void handleAttempt(unsigned generation, size_t index,
+                           const boost::system::error_code& error);
+        void handleDelay(unsigned generation,
+                         const boost::system::error_code& error);
+        void finish(const boost::system::error_code& error);
+};
+
+}
+
+#endif
@@ -12,7 +12,9 @@ enum {
     resolveError,
     invalidStatus,
     connectionTimeout,
-    invalidChunkLength
+    invalidChunkLength,
+    queueOverflow,
+    responseTooLarge
 };
 
 struct CasterError : std::runtime_error {
@@ -36,6 +38,10 @@ class CasterCategory : public boost::system::error_category
                     return "Connection timeout";
                 case invalidChunkLength:
                     return "Invalid chunk length";
+                case queueOverflow:
+                    return "Outbound queue overflow";
+                case responseTooLarge:
+                    return "Response headers too large";
                 default:
                     return "Unknown error";
             };
@@ -0,0 +1,123 @@
+#ifndef __CASTER_HANDLER_MEMORY_H__
+#define __CASTER_HANDLER_MEMORY_H__
+
+#include <boost/asio/associated_allocator.hpp>
+
+#include <atomic>
+#include <memory>
+#include <new>
+#include <utility>
+#include <type_traits>
+#include <cstddef>
+
+namespace Caster {
+
+// Small fixed arena for the operations a connection keeps in flight. Asio
+// only caches two blocks per thread, so a read, a write and the strand
+// passing completions around end up allocating per frame. Operations are
+// freed on whatever thread completes them, hence the atomic slots; larger
+// or excess requests fall back to the heap.
+class HandlerMemory
+{
+    public:
+        HandlerMemory() = default;
+
+        HandlerMemory(const HandlerMemory&) = delete;
+        HandlerMemory& operator=(const HandlerMemory&) = delete;
+
+        void* allocate(size_t size);
+        void deallocate(void* pointer);
+
+    private:
+        static constexpr size_t slots = 4;
+        // Fits a gather write of chunk frames, the largest operation.
+        static constexpr size_t slotSize = 512;
+
+        alignas(std::max_align_t) unsigned char m_storage[slots][slotSize];
+        std::atomic<bool> m_used[slots] = {};
+};
+
+inline
+void* HandlerMemory::allocate(size_t size)
+{
+    if (size <= slotSize)
+    {
+        for (size_t i = 0; i < slots; ++i)
+        {
+            if (!m_used[i].exchange(true, std::memory_order_acquire))
+                return m_storage[i];
+        }
+    }
+    return ::operator new(size);
+}
+
+inline
+void HandlerMemory::deallocate(void* pointer)
+{
+    for (size_t i = 0; i < slots; ++i)
+    {
+        if (pointer == m_storage[i])
+        {
+            m_used[i].store(false, std::memory_order_release);
+            return;
+        }
+    }
+    ::operator delete(pointer);
+}
+
+template <typename T>
+class HandlerAllocator
+{
+    public:
+        using value_type = T;
+
+        explicit HandlerAllocator(HandlerMemory& memory) : m_memory(&memory) {}
+
+        template <typename U>
+        HandlerAllocator(const HandlerAllocator<U>& other) noexcept : m_memory(other.m_memory) {}
+
+        T* allocate(size_t n) { return static_cast<T*>(m_memory->allocate(sizeof(T) * n)); }
+        void deallocate(T* pointer, size_t) { m_memory->deallocate(pointer); }
+
+        template <typename U>
+        bool operator==(const HandlerAllocator<U>& other) const noexcept { return m_memory == other.m_memory; }
+        template <typename U>
+        bool operator!=(const HandlerAllocator<U>& other) const noexcept { return m_memory != other.m_memory; }
+
+    private:
+        HandlerMemory* m_memory;
+
+        template <typename> friend class HandlerAllocator;
+};
+
+// Completion handler whose operation is allocated from a HandlerMemory,
+// found by Asio through get_allocator().
+template <typename Handler>
+class AllocHandler
+{
+    public:
+        using allocator_type = HandlerAllocator<Handler>;
+
+        AllocHandler(HandlerMemory& memory, Handler handler)
+            : m_memory(memory), m_handler(std::move(handler)) {}
+
+        allocator_type get_allocator() const noexcept { return allocator_type(m_memory); }
+
+        template <typename... Args>
+        void operator()(Args&&... args) { m_handler(std::forward<Args>(args)...); }
+
+    private:
+        HandlerMemory& m_memory;
+        Handler m_handler;
+};
+
+template <typename Handler>
+inline
+AllocHandler<std::decay_t<Handler>> makeAllocHandler(HandlerMemory& memory, Handler&& handler)
+{
+    return AllocHandler<std::decay_t<Handler>>(memory, std::forward<Handler>(handler));
+}
+
+}
+
+#endif
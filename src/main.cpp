@@ -1,13 +1,19 @@
 #include "relay.h"
+#include "shards.h"
 #include "logger.h"
 #include "settings.h"
+#include "tls_context.h"
 #include "version.h"
 #include "error.h"
 
 #include <boost/system/error_code.hpp>
 
 #include <iostream>
+#include <vector>
+#include <string>
 #include <functional> // std::bind
+#include <thread>
+#include <chrono>
 #include <exception>
 #include <csignal>
 #include <cerrno>
@@ -18,9 +24,17 @@
 using namespace MADF;
 using namespace Caster;
 
+#if defined(BOOST_ASIO_HAS_IO_URING) && defined(BOOST_ASIO_DISABLE_EPOLL)
+const char* const ioBackend = "io_uring";
+#else
+const char* const ioBackend = "reactor";
+#endif
+
 void configureLogger(const SettingsParser& parser);
-void printError(const boost::system::error_code& code);
-void printHeaders(const RelayPtr& relayPtr);
+RelayPtr makeRelay(boost::asio::io_service& ioService, const RelaySettings& settings);
+void printRelaySettings(const RelaySettings& settings);
+void printError(const std::string& name, const boost::system::error_code& code);
+void printHeaders(const std::string& name, const RelayPtr& relayPtr);
 
 int main(int argc, char* argv[])
 {
@@ -54,81 +68,72 @@ int main(int argc, char* argv[])
         return 0;
     }
 
-    if (sParser.settings().sourceServer().empty())
-    {
-        std::cerr << "You must specify source server location" << std::endl;
-        return -1;
-    }
-
-    if (sParser.settings().destinationServer().empty())
-    {
-        std::cerr << "You must specify destination server location" << std::endl;
-        return -1;
-    }
-
     configureLogger(sParser);
 
     if (sParser.settings().isDebug())
     {
         std::cout << "Settings dump:\n"
+                  << "\t- config file: " << sParser.settings().configFile() << "\n"
                   << "\t- connection timeout: " << sParser.settings().connectionTimeout() << "\n"
                   << "\t- debug: " << (sParser.settings().isDebug() ? "yes" : "no") << "\n"
-                  << "\t- destination login: " << sParser.settings().destinationLogin() << "\n"
-                  << "\t- destination mountpoint: " << sParser.settings().destinationMountpoint() << "\n"
-                  << "\t- destination password: " << sParser.settings().destinationPassword() << "\n"
-                  << "\t- destination port: " << sParser.settings().destinationPort() << "\n"
-                  << "\t- destination server: " << sParser.settings().destinationServer() << "\n"
-                  << "\t- GGA: " << sParser.settings().gga() << "\n"
                   << "\t- help: " << (sParser.settings().isHelp() ? "yes" : "no") << "\n"
-                  << "\t- source login: " << sParser.settings().sourceLogin() << "\n"
-                  << "\t- source mountpoint: " << sParser.settings().sourceMountpoint() << "\n"
-                  << "\t- source password: " << sParser.settings().sourcePassword() << "\n"
-                  << "\t- source port: " << sParser.settings().sourcePort() << "\n"
-                  << "\t- source server: " << sParser.settings().sourceServer() << "\n"
+                  << "\t- I/O backend: " << ioBackend << "\n"
+                  << "\t- threads: " << sParser.settings().threads() << "\n"
+                  << "\t- shards: " << sParser.settings().shards() << "\n"
+                  << "\t- rebalance interval: " << sParser.settings().rebalanceInterval() << "\n"
+                  << "\t- TLS CA file: " << sParser.settings().tlsCaFile() << "\n"
+                  << "\t- TLS verify: " << (sParser.settings().tlsVerify() ? "yes" : "no") << "\n"
                   << "\t- verbosity level: " << sParser.settings().verbosity() << "\n"
-                  << "\t- version: " << (sParser.settings().isVersion() ? "yes" : "no") << std::endl;
+                  << "\t- version: " << (sParser.settings().isVersion() ? "yes" : "no") << "\n";
+        for (const auto& relay : sParser.settings().relays())
+            printRelaySettings(relay);
+        std::cout << std::flush;
     }
 
     try
     {
-        boost::asio::io_service ioService;
-        auto relay = std::make_shared<Relay>(ioService,
-                                             sParser.settings().sourceServer(),
-                                             sParser.settings().sourcePort(),
-                                             sParser.settings().sourceMountpoint(),
-                                             sParser.settings().destinationServer(),
-                                             sParser.settings().destinationPort(),
-                                             sParser.settings().destinationMountpoint());
+        TlsContext::getInstance().setVerify(sParser.settings().tlsVerify());
+        if (!sParser.settings().tlsCaFile().empty())
+            TlsContext::getInstance().loadCaFile(sParser.settings().tlsCaFile());
+
+        if (sParser.settings().shards() > 0)
+        {
+            ShardPool shards(sParser.settings().shards(), makeRelay);
+            for (const auto& settings : sParser.settings().relays())
+                shards.add(settings);
 
-        relay->setErrorCallback(printError);
+            ERRLOG(logDebug) << "Starting " << sParser.settings().relays().size() << " relay(s) on "
+                             << shards.shards() << " shard(s)...";
 
-        relay->setHeadersCallback(std::bind(printHeaders, relay));
+            shards.run(sParser.settings().rebalanceInterval());
 
-        if (!sParser.settings().sourceLogin().empty() ||
-            !sParser.settings().sourcePassword().empty())
-        {
-            relay->setSrcCredentials(sParser.settings().sourceLogin(),
-                                     sParser.settings().sourcePassword());
+            ERRLOG(logDebug) << "Stopping...";
+            return 0;
         }
 
-        if (!sParser.settings().destinationLogin().empty() ||
-            !sParser.settings().destinationPassword().empty())
-        {
-            relay->setDstCredentials(sParser.settings().destinationLogin(),
-                                     sParser.settings().destinationPassword());
-        }
+        boost::asio::io_service ioService;
+        std::vector<RelayPtr> relays;
 
-        if (!sParser.settings().gga().empty())
-            relay->setGGA(sParser.settings().gga());
+        for (const auto& settings : sParser.settings().relays())
+            relays.push_back(makeRelay(ioService, settings));
 
         ERRLOG(logDebug) << "Before starting...";
 
-        relay->start(sParser.settings().connectionTimeout());
+        for (size_t i = 0; i < relays.size(); ++i)
+            relays[i]->start(sParser.settings().relays()[i].connectionTimeout);
+
+        ERRLOG(logDebug) << "Starting " << relays.size() << " relay(s) on "
+                         << sParser.settings().threads() << " thread(s)...";
 
-        ERRLOG(logDebug) << "Starting...";
+        std::vector<std::thread> pool;
+        for (unsigned i = 1; i < sParser.settings().threads(); ++i)
+            pool.emplace_back([&ioService]() { ioService.run(); });
 
         ioService.run();
 
+        for (auto& thread : pool)
+            thread.join();
+
         ERRLOG(logDebug) << "Stopping...";
     }
     catch (const CasterError& e)
@@ -144,6 +149,96 @@ int main(int argc, char* argv[])
     return 0;
 }
 
+RelayPtr makeRelay(boost::asio::io_service& ioService, const RelaySettings& settings)
+{
+    auto relay = std::make_shared<Relay>(ioService,
+                                         settings.source.server,
+                                         settings.source.port,
+                                         settings.source.mountpoint);
+
+    relay->setName(settings.name);
+
+    relay->setErrorCallback(std::bind(printError, settings.name, std::placeholders::_1));
+
+    relay->setHeadersCallback(std::bind(printHeaders, settings.name, relay));
+
+    if (!settings.source.login.empty() || !settings.source.password.empty())
+        relay->setSrcCredentials(settings.source.login, settings.source.password);
+
+    relay->setSrcSocketProfile(settings.source.socketProfile);
+    relay->setSrcTls(settings.source.tls);
+    relay->setSrcReconnectPolicy(settings.source.reconnect);
+
+    if (!settings.standby.server.empty())
+    {
+        relay->setStandby(settings.standby.server,
+                          settings.standby.port,
+                          settings.standby.mountpoint);
+        if (!settings.standby.login.empty() || !settings.standby.password.empty())
+            relay->setStandbyCredentials(settings.standby.login, settings.standby.password);
+        relay->setStandbySocketProfile(settings.source.socketProfile);
+        relay->setStandbyTls(settings.source.tls);
+        relay->setStandbySilence(std::chrono::milliseconds(settings.standbySilence));
+    }
+    relay->setSplice(settings.splice);
+
+    for (const auto& destination : settings.destinations)
+    {
+        Server& server = relay->addDestination(destination.server,
+                                               destination.port,
+                                               destination.mountpoint);
+        if (!destination.login.empty() || !destination.password.empty())
+            server.setCredentials(destination.login, destination.password);
+        server.setSocketProfile(destination.socketProfile);
+        server.setTls(destination.tls);
+        server.setQueueLimit(settings.queueLimit);
+        server.setOverflowPolicy(settings.overflowPolicy);
+        server.setNtripVersion(destination.ntripVersion);
+        relay->setDstReconnectPolicy(server, destination.reconnect);
+    }
+
+    if (!settings.gga.empty())
+        relay->setGGA(settings.gga);
+
+    return relay;
+}
+
+void printRelaySettings(const RelaySettings& settings)
+{
+    std::cout << "Relay " << settings.name << ":\n"
+              << "\t- connection timeout: " << settings.connectionTimeout << "\n"
+              << "\t- GGA: " << settings.gga << "\n"
+              << "\t- queue limit: " << settings.queueLimit << "\n"
+              << "\t- splice: " << (settings.splice ? "yes" : "no") << "\n"
+              << "\t- source login: " << settings.source.login << "\n"
+              << "\t- source mountpoint: " << settings.source.mountpoint << "\n"
+              << "\t- source password: " << settings.source.password << "\n"
+              << "\t- source port: " << settings.source.port << "\n"
+              << "\t- source reconnect: " << (settings.source.reconnect.enabled ? "yes" : "no") << "\n"
+              << "\t- source server: " << settings.source.server << "\n"
+              << "\t- source TLS: " << (settings.source.tls ? "yes" : "no") << "\n";
+    if (!settings.standby.server.empty())
+    {
+        std::cout << "\t- standby login: " << settings.standby.login << "\n"
+                  << "\t- standby mountpoint: " << settings.standby.mountpoint << "\n"
+                  << "\t- standby password: " << settings.standby.password << "\n"
+                  << "\t- standby port: " << settings.standby.port << "\n"
+                  << "\t- standby server: " << settings.standby.server << "\n"
+                  << "\t- standby silence: " << settings.standbySilence << "\n";
+    }
+    for (const auto& destination : settings.destinations)
+    {
+        std::cout << "\t- destination login: " << destination.login << "\n"
+                  << "\t- destination mountpoint: " << destination.mountpoint << "\n"
+                  << "\t- destination NTRIP version: " << (destination.ntripVersion == NtripVersion::v1 ? 1 : 2) << "\n"
+                  << "\t- destination password: " << destination.password << "\n"
+                  << "\t- destination port: " << destination.port << "\n"
+                  << "\t- destination reconnect: " << (destination.reconnect.enabled ? "yes" : "no") << "\n"
+                  << "\t- destination server: " << destination.server << "\n"
+                  << "\t- destination TLS: " << (destination.tls ? "yes" : "no") << "\n";
+    }
+}
+
 void configureLogger(const SettingsParser& parser)
 {
     if (parser.settings().isDebug())
@@ -178,13 +273,21 @@ void configureLogger(const SettingsParser& parser)
     }
 }
 
-void printError(const boost::system::error_code& code)
+void printError(const std::string& name, const boost::system::error_code& code)
 {
-    ERRLOG(logError) << "Relay error: " << code.message();
+    if (name.empty())
+        ERRLOG(logError) << "Relay error: " << code.message();
+    else
+        ERRLOG(logError) << "Relay " << name << " error: " << code.message();
 }
 
-void printHeaders(const RelayPtr& relayPtr)
+void printHeaders(const std::string& name, const RelayPtr& relayPtr)
 {
     for (const auto& kv : relayPtr->headers())
-        ERRLOG(logInfo) << kv.first << ": " << kv.second;
+    {
+        if (name.empty())
+            ERRLOG(logInfo) << kv.first << ": " << kv.second;
+        else
+            ERRLOG(logInfo) << name << ": " << kv.first << ": " << kv.second;
+    }
 }
@@ -0,0 +1,37 @@
+#ifndef __CASTER_POLICIES_H__
+#define __CASTER_POLICIES_H__
+
+#include <chrono>
+
+namespace Caster {
+
+// What a destination does when its outbound queue exceeds the memory budget.
+enum class OverflowPolicy
+{
+    dropOldest,
+    dropNewest,
+    disconnect
+};
+
+// How a destination uploads: an NTRIP 1.0 SOURCE request followed by the
+// raw stream, or an NTRIP 2.0 POST with chunked transfer encoding.
+enum class NtripVersion
+{
+    v1,
+    v2
+};
+
+// How a relay brings back one of its sides after it failed. The n-th retry
+// in a row waits a random time between half and all of delay * 2^n, capped
+// at maxDelay, so relays that lost the same caster do not come back in
+// lockstep.
+struct ReconnectPolicy
+{
+    bool enabled = false;
+    std::chrono::milliseconds delay{1000};
+    std::chrono::milliseconds maxDelay{60000};
+};
+
+}
+
+#endif
@@ -0,0 +1,61 @@
+#include "reconnector.h"
+
+#include <algorithm>
+#include <utility>
+
+using Caster::Reconnector;
+
+namespace pls = std::placeholders;
+namespace bs = boost::system;
+namespace ba = boost::asio;
+
+Reconnector::Reconnector(const Strand& strand)
+    : m_timer(strand),
+      m_random(std::random_device()()),
+      m_attempts(0),
+      m_generation(0)
+{
+}
+
+std::chrono::milliseconds Reconnector::schedule(const Handler& handler)
+{
+    cancel();
+    const std::chrono::milliseconds delay = nextDelay();
+    m_handler = handler;
+    m_timer.expires_after(delay);
+    m_timer.async_wait(std::bind(&Reconnector::handleTimer, this, m_generation, pls::_1));
+    return delay;
+}
+
+void Reconnector::cancel()
+{
+    ++m_generation;
+    m_timer.cancel();
+    m_handler = {};
+}
+
+std::chrono::milliseconds Reconnector::nextDelay()
+{
+    using std::chrono::milliseconds;
+
+    // Stop doubling at the cap, so a long outage can not overflow the delay.
+    milliseconds delay = m_policy.delay;
+    for (unsigned i = 0; i < m_attempts && delay < m_policy.maxDelay; ++i)
+        delay *= 2;
+    delay = std::min(delay, m_policy.maxDelay);
+    ++m_attempts;
+
+    std::uniform_int_distribution<milliseconds::rep> jitter(delay.count() / 2, delay.count());
+    return milliseconds(jitter(m_random));
+}
+
+void Reconnector::handleTimer(unsigned generation, const bs::error_code& error)
+{
+    if (error == ba::error::operation_aborted || generation != m_generation)
+        return;
+
+    Handler handler;
+    std::swap(handler, m_handler);
+    if (handler)
+        handler();
+}
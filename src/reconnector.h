@@ -0,0 +1,49 @@
+#ifndef __CASTER_RECONNECTOR_H__
+#define __CASTER_RECONNECTOR_H__
+
+#include "policies.h"
+#include "strand.h"
+
+#include <boost/system/error_code.hpp>
+
+#include <chrono>
+#include <functional>
+#include <random>
+
+namespace Caster {
+
+// Delays bringing a failed connection back according to a ReconnectPolicy.
+// Every retry in a row doubles the delay until the connection is healthy
+// again and reset() is called.
+class Reconnector
+{
+    public:
+        using Handler = std::function<void ()>;
+
+        explicit Reconnector(const Strand& strand);
+
+        void setPolicy(const ReconnectPolicy& policy) { m_policy = policy; }
+        bool enabled() const { return m_policy.enabled; }
+
+        // Runs the handler on the strand once the delay, which is returned,
+        // has passed.
+        std::chrono::milliseconds schedule(const Handler& handler);
+        void reset() { m_attempts = 0; }
+        void cancel();
+
+    private:
+        ReconnectPolicy m_policy;
+        StrandTimer m_timer;
+        std::minstd_rand m_random;
+        unsigned m_attempts;
+        unsigned m_generation;
+        Handler m_handler;
+
+        std::chrono::milliseconds nextDelay();
+        void handleTimer(unsigned generation,
+                         const boost::system::error_code& error);
+};
+
+}
+
+#endif
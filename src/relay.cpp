@@ -1,80 +1,507 @@
 #include "relay.h"
 
+#include "logger.h"
+
+#include <algorithm>
 #include <functional> // std::bind
 
+#define ERRLOG(level) LOG(CerrWriter, level)
+
+using namespace MADF;
 using Caster::Relay;
+using Caster::Server;
 
 namespace pls = std::placeholders;
 
+Relay::Relay(boost::asio::io_service& ioService,
+             const std::string& srcServer, uint16_t srcPort,
+             const std::string& srcMountpoint)
+    : m_strand(boost::asio::make_strand(ioService)),
+      m_primary(this, m_strand, srcServer, srcPort, srcMountpoint),
+      m_source(&m_primary),
+      m_silenceTimer(m_strand),
+      m_silence(1500),
+      m_liveServers(0),
+      m_received(0),
+      m_switchovers(0),
+      m_reconnects(0),
+      m_timeout(0),
+      m_splice(false),
+      m_splicing(false),
+      m_switching(false),
+      m_running(false)
+{
+}
+
 Relay::Relay(boost::asio::io_service& ioService,
              const std::string& srcServer, uint16_t srcPort,
              const std::string& srcMountpoint,
              const std::string& dstServer, uint16_t dstPort,
              const std::string& dstMountpoint)
-    : m_client(ioService, srcServer, srcPort, srcMountpoint),
-      m_server(ioService, dstServer, dstPort, dstMountpoint)
+    : Relay(ioService, srcServer, srcPort, srcMountpoint)
+{
+    addDestination(dstServer, dstPort, dstMountpoint);
+}
+
+Server& Relay::addDestination(const std::string& dstServer, uint16_t dstPort,
+                              const std::string& dstMountpoint)
+{
+    m_servers.push_back(std::make_unique<Server>(m_strand, dstServer, dstPort, dstMountpoint));
+    m_serverRetries.push_back(std::make_unique<Reconnector>(m_strand));
+    return *m_servers.back();
+}
+
+void Relay::setStandby(const std::string& server, uint16_t port,
+                       const std::string& mountpoint)
+{
+    m_standby = std::make_unique<Source>(this, m_strand, server, port, mountpoint);
+}
+
+void Relay::setGGA(const std::string& gga)
+{
+    m_primary.client.setGGA(gga);
+    if (m_standby)
+        m_standby->client.setGGA(gga);
+}
+
+void Relay::setDstReconnectPolicy(const Server& server,
+                                  const ReconnectPolicy& policy)
+{
+    m_serverRetries[indexOf(&server)]->setPolicy(policy);
+}
+
+size_t Relay::indexOf(const Server* server) const
+{
+    const auto it = std::find_if(m_servers.begin(), m_servers.end(), [server](const auto& candidate) {
+        return candidate.get() == server;
+    });
+    return static_cast<size_t>(it - m_servers.begin());
+}
+
+void Relay::start()
+{
+    start(0);
+}
+
+void Relay::start(unsigned timeout)
+{
+    // May be called from any thread, the connections are only touched on
+    // the relay strand.
+    boost::asio::dispatch(m_strand, std::bind(&Relay::doStart, shared_from_this(), timeout));
+}
+
+void Relay::stop()
+{
+    boost::asio::dispatch(m_strand, std::bind(&Relay::doStop, shared_from_this()));
+}
+
+void Relay::doStart(unsigned timeout)
 {
+    m_running = true;
+    m_timeout = timeout;
+    m_source = &m_primary;
+    m_switching = false;
+    initCallbacks();
+    startSource(&m_primary);
+    if (m_standby)
+    {
+        startSource(m_standby.get());
+        armSilenceTimer();
+    }
+    for (auto& server : m_servers)
+        server->start(timeout);
+}
+
+void Relay::startSource(Source* source)
+{
+    source->retry.setPolicy(m_srcReconnect);
+    source->failed = false;
+    // Silence is only counted from the start on.
+    source->lastData = std::chrono::steady_clock::now();
+    source->client.start(m_timeout);
+}
+
+void Relay::setDstCredentials(const std::string& login,
+                              const std::string& password)
+{
+    for (auto& server : m_servers)
+        server->setCredentials(login, password);
+}
+
+uint64_t Relay::droppedBytes() const
+{
+    uint64_t bytes = 0;
+    for (const auto& server : m_servers)
+        bytes += server->droppedBytes();
+    return bytes;
+}
+
+uint64_t Relay::droppedFrames() const
+{
+    uint64_t frames = 0;
+    for (const auto& server : m_servers)
+        frames += server->droppedFrames();
+    return frames;
 }
 
 void Relay::initCallbacks()
 {
-    m_client.setErrorCallback(
+    initCallbacks(&m_primary);
+    if (m_standby)
+        initCallbacks(m_standby.get());
+    for (auto& server : m_servers)
+    {
+        server->setErrorCallback(
+            std::bind(
+                &Relay::handleServerError,
+                shared_from_this(),
+                server.get(),
+                pls::_1
+            )
+        );
+    }
+    m_liveServers = m_servers.size();
+    armSplice();
+}
+
+void Relay::initCallbacks(Source* source)
+{
+    source->client.setErrorCallback(
         std::bind(
             &Relay::handleError,
             shared_from_this(),
+            source,
             pls::_1
         )
     );
-    m_client.setDataCallback(
+    source->client.setEOFCallback(
+        std::bind(
+            &Relay::handleEOF,
+            shared_from_this(),
+            source
+        )
+    );
+}
+
+void Relay::armSplice()
+{
+    // Bytes can only bypass the framer when there is nobody to share them
+    // with, no queue policy to apply and no standby to switch to. TLS
+    // records can not be moved between sockets as they are.
+    if (m_splice && m_servers.size() == 1 && !m_standby &&
+        !m_primary.client.tls() && !m_servers.front()->tls())
+    {
+        m_primary.client.setPassthroughCallback(
+            std::bind(
+                &Relay::startSplice,
+                shared_from_this()
+            )
+        );
+    }
+}
+
+void Relay::clearCallbacks()
+{
+    for (Source* source : {&m_primary, m_standby.get()})
+    {
+        if (!source)
+            continue;
+        source->client.resetErrorCallback();
+        source->client.resetEOFCallback();
+        source->client.resetPassthroughCallback();
+    }
+    if (m_splicer)
+    {
+        m_servers.front()->setIdleCallback({});
+        m_splicer->setErrorCallback({});
+        m_splicer->setEOFCallback({});
+        m_splicer->setSplicedCallback({});
+    }
+    for (auto& server : m_servers)
+        server->resetErrorCallback();
+}
+
+void Relay::handleError(Source* source, const boost::system::error_code& ec)
+{
+    if (m_errorCallback)
+        m_errorCallback(ec);
+    sourceFailed(source);
+}
+
+void Relay::handleEOF(Source* source)
+{
+    if (m_eofCallback)
+        m_eofCallback();
+    sourceFailed(source);
+}
+
+void Relay::sourceFailed(Source* source)
+{
+    // A spliced destination may have been left in the middle of a chunk.
+    const bool spliced = stopSplice();
+    if (source == m_source && m_standby)
+    {
+        Source* other = source == &m_primary ? m_standby.get() : &m_primary;
+        if (!other->failed)
+            switchTo(other, "failure");
+    }
+    restartSource(source);
+    if (spliced)
+        restartServer(m_servers.front().get());
+}
+
+void Relay::switchTo(Source* source, const char* reason)
+{
+    // The new source joins at its next frame, whatever is left of the
+    // current one is dropped by the destinations.
+    m_source = source;
+    m_switching = true;
+    m_switchovers.fetch_add(1, std::memory_order_relaxed);
+    ERRLOG(logInfo) << "Relay " << m_name << " switched to the " << describe(source)
+                    << " after " << reason;
+}
+
+void Relay::armSilenceTimer()
+{
+    // While nothing is to be switched to, check again a bit later.
+    const auto now = std::chrono::steady_clock::now();
+    m_silenceTimer.expires_at(std::max(m_source->lastData + m_silence, now + m_silence / 4));
+    m_silenceTimer.async_wait(
         std::bind(
-            &Relay::handleData,
+            &Relay::handleSilence,
             shared_from_this(),
             pls::_1
         )
     );
-    m_client.setEOFCallback(
+}
+
+void Relay::handleSilence(const boost::system::error_code& error)
+{
+    if (error == boost::asio::error::operation_aborted || !m_running)
+        return;
+
+    const auto now = std::chrono::steady_clock::now();
+    Source* other = m_source == &m_primary ? m_standby.get() : &m_primary;
+    if (now - m_source->lastData >= m_silence && now - other->lastData < m_silence)
+        switchTo(other, "silence");
+    armSilenceTimer();
+}
+
+const char* Relay::describe(const Source* source) const
+{
+    if (!m_standby)
+        return "source";
+    return source == &m_primary ? "primary source" : "standby source";
+}
+
+void Relay::handleServerError(Server* server,
+                              const boost::system::error_code& ec)
+{
+    if (m_errorCallback)
+        m_errorCallback(ec);
+    // The source is not read while spliced, it has to start over as well.
+    const bool spliced = stopSplice();
+    restartServer(server);
+    if (spliced)
+        restartSource(&m_primary);
+}
+
+void Relay::restartSource(Source* source)
+{
+    if (!m_running)
+        return;
+    source->client.stop();
+    source->framer.reset();
+    if (!source->retry.enabled())
+    {
+        // The relay carries on as long as one of its sources is left.
+        source->failed = true;
+        if (!m_standby || (m_primary.failed && m_standby->failed))
+            doStop();
+        return;
+    }
+
+    const auto delay = source->retry.schedule(
         std::bind(
-            &Relay::handleEOF,
-            shared_from_this()
+            &Relay::reconnectSource,
+            shared_from_this(),
+            source
         )
     );
-    m_server.setErrorCallback(
+    ERRLOG(logInfo) << "Relay " << m_name << " reconnects to the " << describe(source)
+                    << " in " << delay.count() << " ms";
+}
+
+void Relay::restartServer(Server* server)
+{
+    if (!m_running)
+        return;
+    const size_t index = indexOf(server);
+    Reconnector& retry = *m_serverRetries[index];
+    if (!retry.enabled())
+    {
+        dropServer(server);
+        return;
+    }
+
+    // The others keep getting data meanwhile.
+    server->stop();
+    const auto delay = retry.schedule(
         std::bind(
-            &Relay::handleError,
+            &Relay::reconnectServer,
             shared_from_this(),
-            pls::_1
+            server
         )
     );
+    ERRLOG(logInfo) << "Relay " << m_name << " reconnects to destination "
+                    << index << " in " << delay.count() << " ms";
 }
 
-void Relay::clearCallbacks()
+void Relay::dropServer(Server* server)
 {
-    m_client.resetErrorCallback();
-    m_client.resetDataCallback();
-    m_client.resetEOFCallback();
-    m_server.resetErrorCallback();
+    // A failing destination must not take the others down with it, the
+    // relay only stops once none of them is left.
+    server->resetErrorCallback();
+    server->stop();
+    if (--m_liveServers == 0)
+        doStop();
 }
 
-void Relay::handleError(const boost::system::error_code& ec)
+void Relay::reconnectSource(Source* source)
 {
-    if (m_errorCallback)
-        m_errorCallback(ec);
-    clearCallbacks();
-    m_client.stop();
-    m_server.stop();
+    ++m_reconnects;
+    source->client.start(m_timeout);
 }
 
-void Relay::handleData(const boost::asio::const_buffers_1& buffers)
+void Relay::reconnectServer(Server* server)
 {
-    if (m_server.isActive())
-        m_server.send(buffers);
+    ++m_reconnects;
+    server->start(m_timeout);
 }
 
-void Relay::handleEOF()
+void Relay::handleData(Source* source, const Slice& slice)
 {
-    if (m_eofCallback)
-        m_eofCallback();
+    source->retry.reset();
+    if (m_standby)
+        source->lastData = std::chrono::steady_clock::now();
+    if (source != m_source)
+    {
+        // Followed only to know where its next frame starts.
+        source->framer.feed(slice, [](const Fragment&) {});
+        return;
+    }
+
+    m_received.fetch_add(slice.size(), std::memory_order_relaxed);
+    // Every destination queues its own reference to the same segment.
+    source->framer.feed(slice, [this](const Fragment& fragment) {
+        if (m_switching)
+        {
+            if (!fragment.first)
+                return;
+            m_switching = false;
+        }
+        for (size_t i = 0; i < m_servers.size(); ++i)
+        {
+            if (m_servers[i]->isActive())
+            {
+                m_serverRetries[i]->reset();
+                m_servers[i]->send(fragment);
+            }
+        }
+    });
+}
+
+bool Relay::startSplice()
+{
+    // Switch over only at a frame boundary, so the destination never sees
+    // a frame cut in two.
+    Server& server = *m_servers.front();
+    if (!m_primary.framer.synced() || !server.isActive())
+        return false;
+
+    m_primary.client.resetPassthroughCallback();
+    // Both sockets outlive their sessions, so one splicer serves them all.
+    if (!m_splicer)
+        m_splicer = std::make_unique<Splicer>(m_primary.client.socket(), server.socket());
+    m_splicer->setChunked(server.ntripVersion() == NtripVersion::v2);
+    boost::system::error_code ec;
+    m_splicer->open(ec);
+    if (ec)
+    {
+        ERRLOG(logWarning) << "Relay " << m_name << " can not splice, copying instead: " << ec.message();
+        return false;
+    }
+
+    m_splicing = true;
+    m_splicer->setErrorCallback(
+        std::bind(
+            &Relay::handleError,
+            shared_from_this(),
+            &m_primary,
+            pls::_1
+        )
+    );
+    m_splicer->setEOFCallback(
+        std::bind(
+            &Relay::handleEOF,
+            shared_from_this(),
+            &m_primary
+        )
+    );
+    m_splicer->setSplicedCallback([this](size_t size) {
+        m_received.fetch_add(size, std::memory_order_relaxed);
+        m_primary.client.touch();
+        m_servers.front()->touch();
+        m_primary.retry.reset();
+        m_serverRetries.front()->reset();
+    });
+
+    // Frames already queued go out first, the source is not read meanwhile.
+    if (server.idle())
+        m_splicer->start();
+    else
+        server.setIdleCallback(std::bind(&Splicer::start, m_splicer.get()));
+    ERRLOG(logDebug) << "Relay " << m_name << " switched to splice pass-through";
+    return true;
+}
+
+bool Relay::stopSplice()
+{
+    if (!m_splicing)
+        return false;
+    m_splicing = false;
+    m_splicer->stop();
+    m_servers.front()->setIdleCallback({});
+    // The next sessions may splice again once they are in sync.
+    if (m_running)
+        armSplice();
+    return true;
+}
+
+void Relay::doStop()
+{
+    if (!m_running)
+        return;
+    m_running = false;
     clearCallbacks();
-    m_client.stop();
-    m_server.stop();
+    stopSplice();
+    m_silenceTimer.cancel();
+    for (Source* source : {&m_primary, m_standby.get()})
+    {
+        if (!source)
+            continue;
+        source->retry.cancel();
+        source->client.stop();
+    }
+    for (auto& retry : m_serverRetries)
+        retry->cancel();
+    for (auto& server : m_servers)
+        server->stop();
+    ERRLOG(logInfo) << "Relay " << m_name << " stopped: received " << received()
+                    << " bytes, dropped " << droppedBytes() << " bytes in "
+                    << droppedFrames() << " frames, reconnected "
+                    << m_reconnects << " times, switched sources "
+                    << switchovers() << " times";
+    if (m_stopCallback)
+        m_stopCallback();
 }
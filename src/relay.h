@@ -4,12 +4,19 @@
 #include "client.h"
 #include "server.h"
 #include "callbacks.h"
+#include "policies.h"
+#include "reconnector.h"
+#include "rtcm.h"
+#include "splicer.h"
 
 #include <boost/system/error_code.hpp>
 #include <boost/asio.hpp>
 
+#include <chrono>
 #include <memory>
+#include <atomic>
 #include <string>
+#include <vector>
 #include <map>
 #include <cstdint>
 
@@ -18,47 +25,144 @@ namespace Caster {
 class Relay : public std::enable_shared_from_this<Relay>
 {
     public:
+        Relay(boost::asio::io_service& ioService,
+              const std::string& srcServer, uint16_t srcPort,
+              const std::string& srcMountpoint);
+
         Relay(boost::asio::io_service& ioService,
               const std::string& srcServer, uint16_t srcPort,
               const std::string& srcMountpoint,
               const std::string& dstServer, uint16_t dstPort,
               const std::string& dstMountpoint);
 
-        void start()
-        { initCallbacks(); m_client.start(); m_server.start(); }
+        Server& addDestination(const std::string& dstServer, uint16_t dstPort,
+                               const std::string& dstMountpoint);
+        // A second source kept connected all the time. Its data is used
+        // from the next frame on once the relayed source failed, or was
+        // silent while the standby was not.
+        void setStandby(const std::string& server, uint16_t port,
+                        const std::string& mountpoint);
+        void setStandbyCredentials(const std::string& login,
+                                   const std::string& password)
+        { m_standby->client.setCredentials(login, password); }
+        void setStandbySocketProfile(const SocketProfile& profile)
+        { m_standby->client.setSocketProfile(profile); }
+        void setStandbyTls(bool tls) { m_standby->client.setTls(tls); }
 
-        void start(unsigned timeout)
-        {
-            initCallbacks();
-            m_client.start(timeout);
-            m_server.start(timeout);
-        }
+        void start();
+        void start(unsigned timeout);
+        void stop();
 
-        void setGGA(const std::string& gga) { m_client.setGGA(gga); }
+        void setName(const std::string& name) { m_name = name; }
+        void setGGA(const std::string& gga);
         void setSrcCredentials(const std::string& login,
                                const std::string& password)
-        { m_client.setCredentials(login, password); }
+        { m_primary.client.setCredentials(login, password); }
         void setDstCredentials(const std::string& login,
-                               const std::string& password)
-        { m_server.setCredentials(login, password); }
+                               const std::string& password);
+        void setSrcSocketProfile(const SocketProfile& profile)
+        { m_primary.client.setSocketProfile(profile); }
+        void setSrcTls(bool tls) { m_primary.client.setTls(tls); }
+        void setSplice(bool splice) { m_splice = splice; }
+        // Applies to the standby source as well.
+        void setSrcReconnectPolicy(const ReconnectPolicy& policy) { m_srcReconnect = policy; }
+        void setStandbySilence(std::chrono::milliseconds silence) { m_silence = silence; }
+        void setDstReconnectPolicy(const Server& server,
+                                   const ReconnectPolicy& policy);
 
         void setErrorCallback(const ErrorCallback& cb) { m_errorCallback = cb; }
         void setEOFCallback(const EOFCallback& cb) { m_eofCallback = cb; }
-        void setHeadersCallback(const HeadersCallback& cb) { m_client.setHeadersCallback(cb); }
+        void setHeadersCallback(const HeadersCallback& cb) { m_primary.client.setHeadersCallback(cb); }
+        void setStopCallback(const StopCallback& cb) { m_stopCallback = cb; }
+
+        const std::map<std::string, std::string>& headers() const { return m_primary.client.headers(); }
 
-        const std::map<std::string, std::string>& headers() const { return m_client.headers(); }
+        size_t destinations() const { return m_servers.size(); }
+        uint64_t received() const { return m_received.load(std::memory_order_relaxed); }
+        uint64_t droppedBytes() const;
+        uint64_t droppedFrames() const;
+        uint64_t switchovers() const { return m_switchovers.load(std::memory_order_relaxed); }
 
     private:
-        Client m_client;
-        Server m_server;
+        struct Source;
+
+        // Hands what a source received straight to handleData().
+        struct Sink
+        {
+            Relay* relay;
+            Source* source;
+
+            void operator()(const Slice& slice) const { relay->handleData(source, slice); }
+        };
+
+        // A source connection along with the framing of its stream, which
+        // is followed even while a standby's data is thrown away.
+        struct Source
+        {
+            Source(Relay* relay, const Strand& strand,
+                   const std::string& server, uint16_t port,
+                   const std::string& mountpoint)
+                : client(strand, server, port, mountpoint, Sink{relay, this}),
+                  retry(strand),
+                  failed(false) {}
+
+            BasicClient<Sink> client;
+            RtcmFramer framer;
+            Reconnector retry;
+            std::chrono::steady_clock::time_point lastData;
+            bool failed;
+        };
+
+        std::string m_name;
+        Strand m_strand;
+        Source m_primary;
+        std::unique_ptr<Source> m_standby;
+        // The source whose data is relayed.
+        Source* m_source;
+        ReconnectPolicy m_srcReconnect;
+        StrandTimer m_silenceTimer;
+        std::chrono::milliseconds m_silence;
+        std::vector<std::unique_ptr<Server>> m_servers;
+        std::vector<std::unique_ptr<Reconnector>> m_serverRetries;
+        size_t m_liveServers;
+        std::unique_ptr<Splicer> m_splicer;
         ErrorCallback m_errorCallback;
         EOFCallback m_eofCallback;
+        StopCallback m_stopCallback;
+        std::atomic<uint64_t> m_received;
+        std::atomic<uint64_t> m_switchovers;
+        uint64_t m_reconnects;
+        unsigned m_timeout;
+        bool m_splice;
+        bool m_splicing;
+        bool m_switching;
+        bool m_running;
 
         void initCallbacks();
+        void initCallbacks(Source* source);
         void clearCallbacks();
-        void handleError(const boost::system::error_code& ec);
-        void handleData(const boost::asio::const_buffers_1& buffers);
-        void handleEOF();
+        void handleError(Source* source, const boost::system::error_code& ec);
+        void handleServerError(Server* server,
+                               const boost::system::error_code& ec);
+        void handleData(Source* source, const Slice& slice);
+        void handleEOF(Source* source);
+        size_t indexOf(const Server* server) const;
+        const char* describe(const Source* source) const;
+        void startSource(Source* source);
+        void sourceFailed(Source* source);
+        void switchTo(Source* source, const char* reason);
+        void armSilenceTimer();
+        void handleSilence(const boost::system::error_code& error);
+        void restartSource(Source* source);
+        void restartServer(Server* server);
+        void dropServer(Server* server);
+        void reconnectSource(Source* source);
+        void reconnectServer(Server* server);
+        void armSplice();
+        bool startSplice();
+        bool stopSplice();
+        void doStart(unsigned timeout);
+        void doStop();
 };
 
 using RelayPtr = std::shared_ptr<Relay>;
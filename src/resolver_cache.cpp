@@ -0,0 +1,80 @@
+#include "resolver_cache.h"
+
+#include "logger.h"
+
+#include <memory>
+
+#define ERRLOG(level) LOG(CerrWriter, level)
+
+using namespace MADF;
+using Caster::ResolverCache;
+
+namespace bs = boost::system;
+namespace ba = boost::asio;
+
+ResolverCache& ResolverCache::getInstance()
+{
+    static ResolverCache cache;
+    return cache;
+}
+
+ResolverCache::ResolverCache()
+    : m_ttl(60),
+      m_negativeTtl(5)
+{
+}
+
+void ResolverCache::setTtl(std::chrono::seconds ttl, std::chrono::seconds negativeTtl)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_ttl = ttl;
+    m_negativeTtl = negativeTtl;
+}
+
+void ResolverCache::resolve(const Strand& strand,
+                            const std::string& host, uint16_t port,
+                            const Handler& handler)
+{
+    const std::string service = std::to_string(port);
+    const std::string key = host + ":" + service;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Entry& entry = m_entries[key];
+    if (!entry.resolving && Clock::now() < entry.expires)
+    {
+        ba::post(strand, std::bind(handler, entry.error, entry.results));
+        return;
+    }
+
+    entry.waiters.push_back(Waiter{strand, handler});
+    if (entry.resolving)
+        return;
+    entry.resolving = true;
+
+    ERRLOG(logDebug) << "Resolving " << key;
+    // The query runs on the io_service of whoever asked first.
+    auto resolver = std::make_shared<ba::ip::tcp::resolver>(strand.get_inner_executor());
+    resolver->async_resolve(host, service, [this, key, resolver](const bs::error_code& error, const Results& results) {
+        complete(key, error, results);
+    });
+}
+
+void ResolverCache::complete(const std::string& key,
+                             const bs::error_code& error,
+                             const Results& results)
+{
+    std::vector<Waiter> waiters;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Entry& entry = m_entries[key];
+        entry.results = results;
+        entry.error = error;
+        if (error != ba::error::operation_aborted)
+            entry.expires = Clock::now() + (error ? m_negativeTtl : m_ttl);
+        entry.resolving = false;
+        waiters.swap(entry.waiters);
+    }
+
+    for (const auto& waiter : waiters)
+        ba::post(waiter.strand, std::bind(waiter.handler, error, results));
+}
@@ -0,0 +1,71 @@
+#ifndef __CASTER_RESOLVER_CACHE_H__
+#define __CASTER_RESOLVER_CACHE_H__
+
+#include "strand.h"
+
+#include <boost/asio.hpp>
+#include <boost/system/error_code.hpp>
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace Caster {
+
+// Process wide cache of name lookups, keyed by host and port. Asio runs
+// getaddrinfo() on a single background thread per io_service, so without
+// it a reconnect storm of relays to one caster queues up behind DNS.
+// Concurrent lookups of one name share a single query, results are kept
+// for a while and failures for a shorter while.
+class ResolverCache
+{
+    public:
+        using Results = boost::asio::ip::tcp::resolver::results_type;
+        using Handler = std::function<void (const boost::system::error_code&, const Results&)>;
+
+        static ResolverCache& getInstance();
+
+        // The handler is posted to the strand.
+        void resolve(const Strand& strand,
+                     const std::string& host, uint16_t port,
+                     const Handler& handler);
+
+        void setTtl(std::chrono::seconds ttl, std::chrono::seconds negativeTtl);
+
+    private:
+        using Clock = std::chrono::steady_clock;
+
+        struct Waiter
+        {
+            Strand strand;
+            Handler handler;
+        };
+
+        struct Entry
+        {
+            Results results;
+            boost::system::error_code error;
+            Clock::time_point expires;
+            std::vector<Waiter> waiters;
+            bool resolving = false;
+        };
+
+        std::mutex m_mutex;
+        std::map<std::string, Entry> m_entries;
+        std::chrono::seconds m_ttl;
+        std::chrono::seconds m_negativeTtl;
+
+        ResolverCache();
+
+        void complete(const std::string& key,
+                      const boost::system::error_code& error,
+                      const Results& results);
+};
+
+}
+
+#endif
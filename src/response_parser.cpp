@@ -0,0 +1,91 @@
+#include "response_parser.h"
+
+#include <cstring>
+
+using Caster::ResponseParser;
+
+namespace
+{
+
+std::string_view trim(std::string_view value)
+{
+    const size_t first = value.find_first_not_of(" \t");
+    if (first == std::string_view::npos)
+        return std::string_view();
+    const size_t last = value.find_last_not_of(" \t");
+    return value.substr(first, last - first + 1);
+}
+
+}
+
+void ResponseParser::reset()
+{
+    m_state = status;
+    m_pos = 0;
+    m_statusLine = std::string_view();
+    m_protocol = std::string_view();
+    m_code = 0;
+    m_name = std::string_view();
+    m_value = std::string_view();
+}
+
+ResponseParser::Result ResponseParser::parse(std::string_view data)
+{
+    if (m_state == done)
+        return complete;
+
+    const void* eol = memchr(data.data() + m_pos, '\n', data.size() - m_pos);
+    if (eol == nullptr)
+        return incomplete;
+
+    const size_t end = static_cast<const char*>(eol) - data.data();
+    std::string_view line = data.substr(m_pos, end - m_pos);
+    if (!line.empty() && line.back() == '\r')
+        line.remove_suffix(1);
+    m_pos = end + 1;
+
+    if (m_state == status)
+    {
+        if (!parseStatus(line))
+            return invalid;
+        // NTRIP 1.0 casters start the payload right after the status line.
+        m_state = isIcy() ? done : headers;
+        return m_state == done ? complete : parse(data);
+    }
+
+    if (line.empty())
+    {
+        m_state = done;
+        return complete;
+    }
+
+    return parseHeader(line) ? header : invalid;
+}
+
+bool ResponseParser::parseStatus(std::string_view line)
+{
+    m_statusLine = line;
+
+    const size_t space = line.find(' ');
+    if (space == 0 || space == std::string_view::npos)
+        return false;
+    m_protocol = line.substr(0, space);
+
+    line.remove_prefix(space);
+    line = trim(line);
+    size_t digits = 0;
+    m_code = 0;
+    while (digits < line.size() && line[digits] >= '0' && line[digits] <= '9' && digits < 3)
+        m_code = m_code * 10 + static_cast<unsigned>(line[digits++] - '0');
+    return digits == 3 && (digits == line.size() || line[digits] == ' ');
+}
+
+bool ResponseParser::parseHeader(std::string_view line)
+{
+    const size_t colon = line.find(':');
+    if (colon == 0 || colon == std::string_view::npos)
+        return false;
+    m_name = trim(line.substr(0, colon));
+    m_value = trim(line.substr(colon + 1));
+    return true;
+}
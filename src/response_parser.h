@@ -0,0 +1,58 @@
+#ifndef __CASTER_RESPONSE_PARSER_H__
+#define __CASTER_RESPONSE_PARSER_H__
+
+#include <string_view>
+#include <cstddef>
+
+namespace Caster {
+
+// Resumable parser of the status line and headers of a caster reply, both
+// "ICY 200 OK" and HTTP. It never copies: every call gets all bytes received
+// since the reply started, which may only grow in place between calls, and
+// scanning resumes where the previous call stopped. Returned views point
+// into that buffer.
+class ResponseParser
+{
+    public:
+        enum Result
+        {
+            incomplete, // more bytes are needed
+            header,     // name() and value() hold the next header
+            complete,   // the payload starts at consumed()
+            invalid
+        };
+
+        ResponseParser() { reset(); }
+
+        void reset();
+
+        Result parse(std::string_view data);
+
+        std::string_view statusLine() const { return m_statusLine; }
+        std::string_view protocol() const { return m_protocol; }
+        unsigned code() const { return m_code; }
+        bool isIcy() const { return m_protocol == "ICY"; }
+
+        std::string_view name() const { return m_name; }
+        std::string_view value() const { return m_value; }
+
+        size_t consumed() const { return m_pos; }
+
+    private:
+        enum State { status, headers, done };
+
+        State m_state;
+        size_t m_pos;
+        std::string_view m_statusLine;
+        std::string_view m_protocol;
+        unsigned m_code;
+        std::string_view m_name;
+        std::string_view m_value;
+
+        bool parseStatus(std::string_view line);
+        bool parseHeader(std::string_view line);
+};
+
+}
+
+#endif
@@ -0,0 +1,116 @@
+#ifndef __CASTER_RTCM_H__
+#define __CASTER_RTCM_H__
+
+#include "segment.h"
+
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+
+namespace Caster {
+
+// Part of a unit of the correction stream. A unit is an RTCM 3 frame
+// (preamble, 10-bit length, payload and CRC) or, between frames, a run of
+// bytes without a preamble, which is passed on as a unit of its own.
+struct Fragment
+{
+    Slice slice;
+    bool first;
+    bool last;
+};
+
+// Splits received slices at RTCM 3 frame boundaries without copying, so
+// queues can drop whole frames.
+class RtcmFramer
+{
+    public:
+        RtcmFramer() : m_state(sync), m_headerSize(0), m_remaining(0) {}
+
+        template <typename Handler>
+        void feed(const Slice& slice, Handler&& handler);
+
+        void reset() { m_state = sync; }
+        bool synced() const { return m_state == sync; }
+
+    private:
+        enum State { sync, header, body };
+
+        static const uint8_t preamble = 0xD3;
+
+        State m_state;
+        size_t m_headerSize;
+        uint8_t m_header[3];
+        size_t m_remaining;
+
+        size_t scan(const uint8_t* data, size_t size, bool& last);
+};
+
+template <typename Handler>
+inline
+void RtcmFramer::feed(const Slice& slice, Handler&& handler)
+{
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(slice.data());
+    size_t pos = 0;
+    while (pos < slice.size())
+    {
+        const bool first = m_state == sync;
+        bool last = false;
+        const size_t size = scan(data + pos, slice.size() - pos, last);
+        handler(Fragment{slice.sub(pos, size), first, last});
+        pos += size;
+    }
+}
+
+inline
+size_t RtcmFramer::scan(const uint8_t* data, size_t size, bool& last)
+{
+    size_t pos = 0;
+    if (m_state == sync)
+    {
+        if (data[0] != preamble)
+        {
+            const void* next = memchr(data + 1, preamble, size - 1);
+            last = true;
+            return next ? static_cast<const uint8_t*>(next) - data : size;
+        }
+        m_header[0] = data[pos++];
+        m_headerSize = 1;
+        m_state = header;
+    }
+
+    while (m_state == header && pos < size)
+    {
+        m_header[m_headerSize++] = data[pos++];
+        if (m_headerSize == sizeof(m_header))
+        {
+            // Reserved bits must be zero, otherwise this was no preamble.
+            if ((m_header[1] & 0xFC) != 0)
+            {
+                m_state = sync;
+                last = true;
+                return pos;
+            }
+            m_remaining = ((m_header[1] & 0x03) << 8 | m_header[2]) + 3; // CRC-24Q
+            m_state = body;
+        }
+    }
+
+    if (m_state == body)
+    {
+        const size_t chunk = std::min(m_remaining, size - pos);
+        m_remaining -= chunk;
+        pos += chunk;
+        if (m_remaining == 0)
+        {
+            m_state = sync;
+            last = true;
+        }
+    }
+
+    return pos;
+}
+
+}
+
+#endif
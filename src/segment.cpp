@@ -0,0 +1,67 @@
+#include "segment.h"
+
+#include <cstring>
+
+using Caster::Segment;
+using Caster::SegmentPool;
+using Caster::SegmentPtr;
+
+Segment::Segment(SegmentPool* pool, size_t capacity)
+    : m_pool(pool),
+      m_refs(0),
+      m_capacity(capacity),
+      m_size(0),
+      m_data(new char[capacity])
+{
+}
+
+boost::asio::const_buffer Segment::commit(size_t size)
+{
+    const boost::asio::const_buffer committed(m_data.get() + m_size, size);
+    m_size += size;
+    return committed;
+}
+
+void Segment::append(const boost::asio::const_buffer& buffer)
+{
+    memcpy(m_data.get() + m_size, buffer.data(), buffer.size());
+    m_size += buffer.size();
+}
+
+void Caster::intrusive_ptr_release(Segment* segment)
+{
+    if (--segment->m_refs == 0)
+        segment->m_pool->recycle(segment);
+}
+
+SegmentPool::SegmentPool(size_t segmentSize, size_t capacity)
+    : m_segmentSize(segmentSize),
+      m_capacity(capacity)
+{
+    m_free.reserve(capacity);
+}
+
+SegmentPool::~SegmentPool()
+{
+    for (auto segment : m_free)
+        delete segment;
+}
+
+SegmentPtr SegmentPool::acquire()
+{
+    if (m_free.empty())
+        return SegmentPtr(new Segment(this, m_segmentSize));
+
+    Segment* segment = m_free.back();
+    m_free.pop_back();
+    segment->m_size = 0;
+    return SegmentPtr(segment);
+}
+
+void SegmentPool::recycle(Segment* segment)
+{
+    if (m_free.size() < m_capacity)
+        m_free.push_back(segment);
+    else
+        delete segment;
+}
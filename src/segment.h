@@ -0,0 +1,104 @@
+#ifndef __CASTER_SEGMENT_H__
+#define __CASTER_SEGMENT_H__
+
+#include <boost/asio/buffer.hpp>
+#include <boost/smart_ptr/intrusive_ptr.hpp>
+
+#include <vector>
+#include <memory>
+#include <cstddef>
+
+namespace Caster {
+
+class SegmentPool;
+class Segment;
+
+void intrusive_ptr_release(Segment* segment);
+
+// Fixed-size, reference counted block of received bytes. Reads append to
+// the tail, already received bytes are handed out as Slices that keep the
+// segment alive until every queued write referencing them completes.
+// Segments are not thread safe: they must only be touched from the strand
+// of the relay that owns the pool.
+class Segment
+{
+    public:
+        Segment(SegmentPool* pool, size_t capacity);
+
+        Segment(const Segment&) = delete;
+        Segment& operator=(const Segment&) = delete;
+
+        const char* data() const { return m_data.get(); }
+        size_t size() const { return m_size; }
+        size_t capacity() const { return m_capacity; }
+        size_t available() const { return m_capacity - m_size; }
+
+        boost::asio::mutable_buffer tail()
+        { return boost::asio::buffer(m_data.get() + m_size, available()); }
+        boost::asio::const_buffer commit(size_t size);
+
+        void append(const boost::asio::const_buffer& buffer);
+
+    private:
+        SegmentPool* m_pool;
+        size_t m_refs;
+        size_t m_capacity;
+        size_t m_size;
+        std::unique_ptr<char[]> m_data;
+
+        friend class SegmentPool;
+        friend void intrusive_ptr_add_ref(Segment* segment) { ++segment->m_refs; }
+        friend void intrusive_ptr_release(Segment* segment);
+};
+
+using SegmentPtr = boost::intrusive_ptr<Segment>;
+
+// View into a segment which keeps it alive.
+class Slice
+{
+    public:
+        Slice() = default;
+        Slice(const SegmentPtr& segment, const boost::asio::const_buffer& buffer)
+            : m_segment(segment), m_buffer(buffer) {}
+
+        const boost::asio::const_buffer& buffer() const { return m_buffer; }
+        const char* data() const { return static_cast<const char*>(m_buffer.data()); }
+        size_t size() const { return m_buffer.size(); }
+        bool empty() const { return m_buffer.size() == 0; }
+
+        Slice sub(size_t offset, size_t size) const
+        { return Slice(m_segment, boost::asio::buffer(m_buffer + offset, size)); }
+
+    private:
+        SegmentPtr m_segment;
+        boost::asio::const_buffer m_buffer;
+};
+
+// Recycles released segments. Up to `capacity` free segments are retained,
+// the rest are returned to the heap. The pool must outlive all its segments.
+class SegmentPool
+{
+    public:
+        explicit SegmentPool(size_t segmentSize = 4096, size_t capacity = 16);
+        ~SegmentPool();
+
+        SegmentPool(const SegmentPool&) = delete;
+        SegmentPool& operator=(const SegmentPool&) = delete;
+
+        SegmentPtr acquire();
+
+        size_t segmentSize() const { return m_segmentSize; }
+
+    private:
+        size_t m_segmentSize;
+        size_t m_capacity;
+        std::vector<Segment*> m_free;
+
+        void recycle(Segment* segment);
+
+        friend void intrusive_ptr_release(Segment* segment);
+};
+
+}
+
+#endif
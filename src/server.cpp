@@ -1,44 +1,241 @@
 #include "server.h"
 
+#include "error.h"
+#include "logger.h"
+#include "utils.h"
 #include "version.h"
 
-#include <boost/format.hpp>
 #include <boost/asio/buffer.hpp>
 
 #include <iostream>
-#include <array>
+#include <iterator>
+#include <sstream>
+#include <utility>
 
+#define ERRLOG(level) LOG(CerrWriter, level)
+
+using namespace MADF;
 using Caster::Server;
 
-Server::Server(boost::asio::io_service& ioService,
+namespace
+{
+
+// Non-owning view of the gather list. Asio copies the buffer sequence into
+// the write operation, and copying a vector would allocate on every write.
+class BufferView
+{
+    public:
+        using value_type = boost::asio::const_buffer;
+        using const_iterator = const boost::asio::const_buffer*;
+
+        explicit BufferView(const std::vector<boost::asio::const_buffer>& buffers)
+            : m_begin(buffers.data()), m_end(buffers.data() + buffers.size()) {}
+
+        const_iterator begin() const { return m_begin; }
+        const_iterator end() const { return m_end; }
+
+    private:
+        const_iterator m_begin;
+        const_iterator m_end;
+};
+
+}
+
+Server::Server(const Strand& strand,
                const std::string& server, uint16_t port,
                const std::string& mountpoint)
-    : Connection(ioService, server, port, mountpoint)
+    : BasicConnection(strand, server, port, mountpoint),
+      m_pendingBytes(0),
+      m_complete(0),
+      m_queueLimit(64 * 1024),
+      m_policy(OverflowPolicy::dropOldest),
+      m_version(NtripVersion::v2),
+      m_droppedBytes(0),
+      m_droppedFrames(0),
+      m_writing(false),
+      m_discarding(false)
 {
 }
 
-void Server::send(const boost::asio::const_buffer& buffer)
+void Server::send(const Fragment& fragment)
 {
-    const std::string dataLength((boost::format("%|x|\r\n") % boost::asio::buffer_size(buffer)).str());
-    const std::array<boost::asio::const_buffer, 3> bufs = {{
-        boost::asio::buffer(dataLength),
-        boost::asio::buffer(buffer),
-        boost::asio::buffer("\r\n", 2)
-    }};
-    Connection::send(bufs);
+    const size_t size = fragment.slice.size();
+    if (size == 0)
+        return;
+
+    if (fragment.first)
+    {
+        // A frame that was never finished (the source switched or lost
+        // sync) must not reach the caster.
+        dropIncomplete();
+        m_discarding = !admit(size);
+        if (m_discarding)
+            ++m_droppedFrames;
+    }
+    else if (!m_discarding && m_complete == m_pending.size())
+    {
+        // Joined the stream in the middle of a frame.
+        m_discarding = true;
+    }
+
+    if (m_discarding)
+    {
+        m_droppedBytes += size;
+        return;
+    }
+
+    m_pending.emplace_back();
+    Chunk& chunk = m_pending.back();
+    chunk.headerSize = m_version == NtripVersion::v2 ?
+        static_cast<uint8_t>(Caster::formatChunkHeader(chunk.header.data(), size)) : 0;
+    chunk.payload = fragment.slice;
+    chunk.last = fragment.last;
+    m_pendingBytes += size;
+    if (fragment.last)
+        m_complete = m_pending.size();
+
+    if (!m_writing && m_complete > 0)
+        flush();
+}
+
+bool Server::admit(size_t size)
+{
+    if (m_pendingBytes + size <= m_queueLimit)
+        return true;
+
+    switch (m_policy)
+    {
+        case OverflowPolicy::dropOldest:
+            while (m_complete > 0 && m_pendingBytes + size > m_queueLimit)
+                dropOldest();
+            if (m_pendingBytes + size <= m_queueLimit)
+                return true;
+            break;
+        case OverflowPolicy::dropNewest:
+            break;
+        case OverflowPolicy::disconnect:
+            ERRLOG(logWarning) << "Outbound queue limit of " << m_queueLimit
+                               << " bytes exceeded, disconnecting";
+            reportError(queueOverflow);
+            shutdown();
+            return false;
+    }
+
+    ERRLOG(logDebug) << "Outbound queue limit of " << m_queueLimit
+                     << " bytes reached, dropping a frame";
+    return false;
 }
 
-void Server::prepareRequest()
+void Server::dropOldest()
 {
-    std::ostream requestStream(&m_request);
-    requestStream << "POST " << m_uri << " HTTP/1.1\r\n"
-                  << "Host: " << m_server << "\r\n"
-                  << "Ntrip-Version: Ntrip/2.0\r\n"
-                  << "User-Agent: Boost.Asio NTRIP Server " << version
-                  << "\r\n";
-    if (m_auth.authenticated())
-        requestStream << "Authorization: Basic " << m_auth.basic() << "\r\n";
-    requestStream << "Connection: close\r\n"
-                  << "Transfer-Encoding: chunked\r\n"
-                  << "\r\n";
+    size_t end = 0;
+    while (!m_pending[end].last)
+        ++end;
+    ++end;
+
+    for (size_t i = 0; i < end; ++i)
+    {
+        m_pendingBytes -= m_pending[i].payload.size();
+        m_droppedBytes += m_pending[i].payload.size();
+    }
+    ++m_droppedFrames;
+    m_pending.erase(m_pending.begin(), m_pending.begin() + end);
+    m_complete -= end;
+}
+
+void Server::dropIncomplete()
+{
+    if (m_complete == m_pending.size())
+        return;
+
+    for (size_t i = m_complete; i < m_pending.size(); ++i)
+    {
+        m_pendingBytes -= m_pending[i].payload.size();
+        m_droppedBytes += m_pending[i].payload.size();
+    }
+    ++m_droppedFrames;
+    m_pending.resize(m_complete);
+}
+
+void Server::handleSent()
+{
+    m_writing = false;
+    m_inflight.clear();
+    if (m_complete > 0)
+    {
+        flush();
+    }
+    else if (m_pending.empty() && m_idleCallback)
+    {
+        IdleCallback cb;
+        std::swap(cb, m_idleCallback);
+        cb();
+    }
+}
+
+void Server::resetSession()
+{
+    // A reconnected caster only gets frames received from now on, the ones
+    // still queued for the lost connection are dropped.
+    dropIncomplete();
+    while (m_complete > 0)
+        dropOldest();
+    m_inflight.clear();
+    m_idleCallback = {};
+    m_writing = false;
+    m_discarding = false;
+}
+
+void Server::flush()
+{
+    // Every complete frame queued so far goes out as a single gather write,
+    // of chunk frames for NTRIP 2.0 and of bare payload for NTRIP 1.0, so
+    // there is never more than one write in flight.
+    m_inflight.assign(std::make_move_iterator(m_pending.begin()),
+                      std::make_move_iterator(m_pending.begin() + m_complete));
+    m_pending.erase(m_pending.begin(), m_pending.begin() + m_complete);
+    m_complete = 0;
+
+    m_buffers.clear();
+    for (const auto& chunk : m_inflight)
+    {
+        m_pendingBytes -= chunk.payload.size();
+        if (chunk.headerSize == 0)
+        {
+            m_buffers.push_back(chunk.payload.buffer());
+            continue;
+        }
+        m_buffers.push_back(boost::asio::buffer(chunk.header.data(), chunk.headerSize));
+        m_buffers.push_back(chunk.payload.buffer());
+        m_buffers.push_back(boost::asio::buffer("\r\n", 2));
+    }
+
+    m_writing = true;
+    BasicConnection::send(BufferView(m_buffers));
+}
+
+void Server::renderRequest(RequestTemplate& request)
+{
+    std::ostringstream head;
+    if (m_version == NtripVersion::v1)
+    {
+        // Only a password is known to NTRIP 1.0.
+        head << "SOURCE " << m_auth.password() << " " << m_uri << "\r\n"
+             << "Source-Agent: NTRIP Boost.Asio NTRIP Server " << version
+             << "\r\n"
+             << "\r\n";
+        request.head = head.str();
+        return;
+    }
+
+    head << "POST " << m_uri << " HTTP/1.1\r\n"
+         << "Host: " << m_server << "\r\n"
+         << "Ntrip-Version: Ntrip/2.0\r\n"
+         << "User-Agent: Boost.Asio NTRIP Server " << version
+         << "\r\n";
+    request.head = head.str();
+    request.method = "POST";
+    request.tail = "Connection: close\r\n"
+                   "Transfer-Encoding: chunked\r\n"
+                   "\r\n";
 }
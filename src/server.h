@@ -1,32 +1,96 @@
 #ifndef __CASTER_SERVER_H__
 #define __CASTER_SERVER_H__
 
-#include "connection.h"
+#include "basic_connection.h"
+#include "policies.h"
+#include "rtcm.h"
 
 #include <boost/asio.hpp>
 
 #include <string>
+#include <vector>
+#include <array>
 #include <cstdint>
+#include <cstddef>
 
 namespace Caster {
 
-class Server : private Connection {
+class Server : private BasicConnection<Server> {
     public:
-        Server(boost::asio::io_service& ioService,
+        Server(const Strand& strand,
                const std::string& server, uint16_t port,
                const std::string& mountpoint);
 
         using Connection::start;
         using Connection::stop;
         using Connection::setCredentials;
+        using Connection::setSocketProfile;
+        using Connection::setTls;
+        using Connection::tls;
         using Connection::setErrorCallback;
         using Connection::resetErrorCallback;
         using Connection::isActive;
+        using Connection::socket;
+        using Connection::touch;
 
-        void send(const boost::asio::const_buffer& buffer);
+        void send(const Fragment& fragment);
+
+        void setQueueLimit(size_t limit) { m_queueLimit = limit; }
+        void setOverflowPolicy(OverflowPolicy policy) { m_policy = policy; }
+        void setNtripVersion(NtripVersion version)
+        {
+            m_version = version;
+            invalidateRequest();
+        }
+        NtripVersion ntripVersion() const { return m_version; }
+        // Called once, when everything queued has been written.
+        void setIdleCallback(const IdleCallback& cb) { m_idleCallback = cb; }
+        size_t queueLimit() const { return m_queueLimit; }
+        size_t queuedBytes() const { return m_pendingBytes; }
+        bool idle() const { return !m_writing && m_pending.empty(); }
+
+        uint64_t droppedBytes() const { return m_droppedBytes; }
+        uint64_t droppedFrames() const { return m_droppedFrames; }
 
     private:
-        void prepareRequest() override;
+        struct Chunk
+        {
+            // Hex chunk size line, kept inline so queuing never allocates.
+            // Empty for NTRIP 1.0.
+            std::array<char, 2 * sizeof(size_t) + 2> header;
+            uint8_t headerSize;
+            Slice payload;
+            bool last;
+        };
+
+        // Only complete frames, m_pending[0, m_complete), are flushed, so
+        // a frame is either written whole or not at all.
+        std::vector<Chunk> m_pending;
+        std::vector<Chunk> m_inflight;
+        std::vector<boost::asio::const_buffer> m_buffers;
+        size_t m_pendingBytes;
+        size_t m_complete;
+        size_t m_queueLimit;
+        OverflowPolicy m_policy;
+        NtripVersion m_version;
+        uint64_t m_droppedBytes;
+        uint64_t m_droppedFrames;
+        IdleCallback m_idleCallback;
+        bool m_writing;
+        bool m_discarding;
+
+        void renderRequest(RequestTemplate& request) override;
+        void resetSession() override;
+        // A caster sends nothing worth reading after the reply head.
+        void handlePayload(const Slice&) {}
+        void handleSent();
+
+        bool admit(size_t size);
+        void dropOldest();
+        void dropIncomplete();
+        void flush();
+
+        friend class BasicConnection<Server>;
 };
 
 }
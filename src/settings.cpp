@@ -2,21 +2,185 @@
 #include "error.h"
 
 #include <boost/lexical_cast.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/ini_parser.hpp>
 
 #include <stdexcept>
 #include <iostream>
+#include <sstream>
+#include <map>
+#include <optional>
 
 using Caster::Settings;
 using Caster::SettingsParser;
+using Caster::RelaySettings;
+using Caster::EndpointSettings;
+
+namespace pt = boost::property_tree;
+
+namespace
+{
+
+struct ProfileOption
+{
+    const char* name;
+    std::optional<unsigned> Caster::SocketProfile::* field;
+    const char* description;
+};
+
+const ProfileOption profileOptions[] = {
+    {"sndbuf", &Caster::SocketProfile::sendBuffer, "socket send buffer size in bytes"},
+    {"rcvbuf", &Caster::SocketProfile::receiveBuffer, "socket receive buffer size in bytes"},
+    {"notsent-lowat", &Caster::SocketProfile::notSentLowat, "unsent bytes threshold (TCP_NOTSENT_LOWAT)"},
+    {"user-timeout", &Caster::SocketProfile::userTimeout, "unacknowledged data timeout in ms (TCP_USER_TIMEOUT)"},
+    {"keepalive-idle", &Caster::SocketProfile::keepAliveIdle, "idle seconds before keepalive probes"},
+    {"keepalive-interval", &Caster::SocketProfile::keepAliveInterval, "seconds between keepalive probes"},
+    {"keepalive-count", &Caster::SocketProfile::keepAliveCount, "keepalive probes before dropping the connection"}
+};
+
+void addSocketProfileOptions(po::options_description& desc,
+                             const std::string& prefix,
+                             const std::string& side)
+{
+    desc.add_options()
+        ((prefix + "nodelay").c_str(), po::value<bool>(), (side + " TCP_NODELAY (0 or 1)").c_str());
+    for (const auto& option : profileOptions)
+        desc.add_options()
+            ((prefix + option.name).c_str(), po::value<unsigned>(), (side + " " + option.description).c_str());
+}
+
+void addReconnectOptions(po::options_description& desc,
+                         const std::string& prefix,
+                         const std::string& side)
+{
+    desc.add_options()
+        ((prefix + "reconnect").c_str(), po::value<bool>(), ("reconnect the " + side + " after a failure (0 or 1)").c_str())
+        ((prefix + "reconnect-delay").c_str(), po::value<unsigned>(), ("first " + side + " reconnect delay in ms, doubled on every retry").c_str())
+        ((prefix + "reconnect-max-delay").c_str(), po::value<unsigned>(), ("maximum " + side + " reconnect delay in ms").c_str());
+}
+
+Caster::ReconnectPolicy makeReconnectPolicy(bool enabled, unsigned delay, unsigned maxDelay)
+{
+    if (delay > maxDelay)
+        throw Caster::CasterError("Reconnect delay exceeds its maximum");
+    Caster::ReconnectPolicy policy;
+    policy.enabled = enabled;
+    policy.delay = std::chrono::milliseconds(delay);
+    policy.maxDelay = std::chrono::milliseconds(maxDelay);
+    return policy;
+}
+
+Caster::ReconnectPolicy parseReconnectPolicy(const po::variables_map& vm,
+                                             const std::string& prefix)
+{
+    const Caster::ReconnectPolicy defaults;
+    bool enabled = defaults.enabled;
+    unsigned delay = static_cast<unsigned>(defaults.delay.count());
+    unsigned maxDelay = static_cast<unsigned>(defaults.maxDelay.count());
+    if (vm.count(prefix + "reconnect") > 0)
+        enabled = vm[prefix + "reconnect"].as<bool>();
+    if (vm.count(prefix + "reconnect-delay") > 0)
+        delay = vm[prefix + "reconnect-delay"].as<unsigned>();
+    if (vm.count(prefix + "reconnect-max-delay") > 0)
+        maxDelay = vm[prefix + "reconnect-max-delay"].as<unsigned>();
+    return makeReconnectPolicy(enabled, delay, maxDelay);
+}
+
+Caster::ReconnectPolicy parseReconnectPolicy(const pt::ptree& section,
+                                             const std::string& prefix)
+{
+    const Caster::ReconnectPolicy defaults;
+    return makeReconnectPolicy(section.get<bool>(prefix + "reconnect", defaults.enabled),
+                               section.get<unsigned>(prefix + "reconnect-delay", static_cast<unsigned>(defaults.delay.count())),
+                               section.get<unsigned>(prefix + "reconnect-max-delay", static_cast<unsigned>(defaults.maxDelay.count())));
+}
+
+Caster::SocketProfile parseSocketProfile(const po::variables_map& vm,
+                                         const std::string& prefix)
+{
+    Caster::SocketProfile profile;
+    if (vm.count(prefix + "nodelay") > 0)
+        profile.noDelay = vm[prefix + "nodelay"].as<bool>();
+    for (const auto& option : profileOptions)
+        if (vm.count(prefix + option.name) > 0)
+            profile.*option.field = vm[prefix + option.name].as<unsigned>();
+    return profile;
+}
+
+Caster::SocketProfile parseSocketProfile(const pt::ptree& section,
+                                         const std::string& prefix)
+{
+    Caster::SocketProfile profile;
+    if (const auto value = section.get_optional<bool>(prefix + "nodelay"))
+        profile.noDelay = *value;
+    for (const auto& option : profileOptions)
+        if (const auto value = section.get_optional<unsigned>(prefix + option.name))
+            profile.*option.field = *value;
+    return profile;
+}
+
+template <typename T>
+void printOptional(std::ostream& stream, const std::optional<T>& value)
+{
+    if (value)
+        stream << *value;
+    stream << "\n";
+}
+
+// Sections whose source settings render to the same key share a relay.
+std::string sourceKey(const RelaySettings& relay)
+{
+    std::ostringstream key;
+    key << relay.source.server << "\n" << relay.source.port << "\n"
+        << relay.source.mountpoint << "\n" << relay.source.login << "\n"
+        << relay.source.password << "\n" << relay.gga << "\n"
+        << relay.connectionTimeout << "\n" << relay.queueLimit << "\n"
+        << static_cast<int>(relay.overflowPolicy) << "\n"
+        << relay.splice << "\n" << relay.source.reconnect.enabled << "\n"
+        << relay.source.reconnect.delay.count() << "\n"
+        << relay.source.reconnect.maxDelay.count() << "\n"
+        << relay.standby.server << "\n" << relay.standby.port << "\n"
+        << relay.standby.mountpoint << "\n" << relay.standby.login << "\n"
+        << relay.standby.password << "\n" << relay.standbySilence << "\n"
+        << relay.source.tls << "\n";
+    printOptional(key, relay.source.socketProfile.noDelay);
+    for (const auto& option : profileOptions)
+        printOptional(key, relay.source.socketProfile.*option.field);
+    return key.str();
+}
+
+Caster::NtripVersion parseNtripVersion(unsigned value)
+{
+    if (value == 1)
+        return Caster::NtripVersion::v1;
+    if (value == 2)
+        return Caster::NtripVersion::v2;
+    throw Caster::CasterError("Invalid NTRIP version " + std::to_string(value));
+}
+
+Caster::OverflowPolicy parseOverflowPolicy(const std::string& value)
+{
+    if (value == "drop-oldest")
+        return Caster::OverflowPolicy::dropOldest;
+    if (value == "drop-newest")
+        return Caster::OverflowPolicy::dropNewest;
+    if (value == "disconnect")
+        return Caster::OverflowPolicy::disconnect;
+    throw Caster::CasterError("Invalid overflow policy '" + value + "'");
+}
+
+}
 
 Settings::Settings() noexcept
     : m_isHelp(true),
       m_isVersion(false),
       m_isDebug(false),
-      m_sourcePort(2101),
-      m_destinationPort(2101),
       m_verbosity(1),
-      m_connectionTimeout(120)
+      m_connectionTimeout(120),
+      m_threads(1),
+      m_shards(0),
+      m_rebalanceInterval(60),
+      m_tlsVerify(true)
 {
 }
 
@@ -26,6 +190,7 @@ SettingsParser::SettingsParser() noexcept
     m_desc.add_options()
         ("help,h", "produce this help message")
         ("debug,d", "NTRIP clinet debugging")
+        ("config,c", po::value<std::string>(), "relay definitions file, one section per relay")
         ("gga,g", po::value<std::string>(), "GPGGA string")
         ("src-mountpoint,M", po::value<std::string>(), "source mountpoint name")
         ("src-login,L", po::value<std::string>(), "source login")
@@ -37,10 +202,31 @@ SettingsParser::SettingsParser() noexcept
         ("dst-password,w", po::value<std::string>(), "destination password")
         ("dst-port,p", po::value<uint16_t>(), "destination server port")
         ("dst-server,s", po::value<std::string>(), "destination server address")
+        ("dst-ntrip-version", po::value<unsigned>(), "destination upload protocol (1 - SOURCE, 2 - chunked POST)")
+        ("src-tls", po::value<bool>(), "connect to the source (and standby) caster over TLS (0 or 1)")
+        ("dst-tls", po::value<bool>(), "connect to the destination caster over TLS (0 or 1)")
+        ("tls-verify", po::value<bool>(), "verify caster certificates and host names (0 or 1)")
+        ("tls-ca-file", po::value<std::string>(), "PEM file with CA certificates to trust besides the system ones")
+        ("standby-mountpoint", po::value<std::string>(), "standby source mountpoint name")
+        ("standby-login", po::value<std::string>(), "standby source login")
+        ("standby-password", po::value<std::string>(), "standby source password")
+        ("standby-port", po::value<uint16_t>(), "standby source server port")
+        ("standby-server", po::value<std::string>(), "standby source server address, kept connected to take over")
+        ("standby-silence", po::value<unsigned>(), "ms without data after which the standby source takes over")
         ("timeout,t", po::value<unsigned>(), "connection timeout")
+        ("queue-limit", po::value<size_t>(), "outbound queue size per destination in bytes")
+        ("overflow-policy", po::value<std::string>(), "queue overflow policy (drop-oldest, drop-newest, disconnect)")
+        ("splice", po::value<bool>(), "move unframed single destination streams with splice() (0 or 1)")
+        ("threads,T", po::value<unsigned>(), "number of threads serving the relays")
+        ("shards", po::value<unsigned>(), "number of share-nothing shards, each on its own pinned thread")
+        ("rebalance-interval", po::value<unsigned>(), "seconds between shard load rebalancing (0 - never)")
         ("verbosity,V", po::value<int>(), "log file verbosity (0 - quiet, 1 - normal, 2 - extra)")
         ("version,v", "show NTRIP client version and exit")
     ;
+    addSocketProfileOptions(m_desc, "src-", "source");
+    addSocketProfileOptions(m_desc, "dst-", "destination");
+    addReconnectOptions(m_desc, "src-", "source");
+    addReconnectOptions(m_desc, "dst-", "destination");
 }
 
 void SettingsParser::init(int argc, char* argv[])
@@ -55,23 +241,83 @@ void SettingsParser::init(int argc, char* argv[])
     if (vm.count("debug") > 0)
         m_settings.m_isDebug = true;
 
+    if (vm.count("verbosity") > 0)
+    {
+        m_settings.m_verbosity = vm["verbosity"].as<int>();
+        if (m_settings.m_verbosity < 1)
+        {
+            m_settings.m_verbosity = 0;
+        }
+        else if (m_settings.m_verbosity > 1)
+        {
+            m_settings.m_verbosity = 2;
+        }
+    }
+
+    if (vm.count("timeout") > 0)
+        m_settings.m_connectionTimeout = vm["timeout"].as<unsigned>();
+
+    if (vm.count("threads") > 0)
+    {
+        m_settings.m_threads = vm["threads"].as<unsigned>();
+        if (m_settings.m_threads == 0)
+            throw CasterError("Number of threads must be positive");
+    }
+
+    if (vm.count("shards") > 0)
+    {
+        m_settings.m_shards = vm["shards"].as<unsigned>();
+        if (m_settings.m_shards > 0 && m_settings.m_threads > 1)
+            throw CasterError("Threads and shards can not be combined");
+    }
+
+    if (vm.count("rebalance-interval") > 0)
+        m_settings.m_rebalanceInterval = vm["rebalance-interval"].as<unsigned>();
+
+    if (vm.count("tls-verify") > 0)
+        m_settings.m_tlsVerify = vm["tls-verify"].as<bool>();
+
+    if (vm.count("tls-ca-file") > 0)
+        m_settings.m_tlsCaFile = vm["tls-ca-file"].as<std::string>();
+
+    if (m_settings.m_isHelp || m_settings.m_isVersion)
+        return;
+
+    if (vm.count("config") > 0)
+    {
+        m_settings.m_configFile = vm["config"].as<std::string>();
+        parseConfigFile(m_settings.m_configFile);
+    }
+    else
+    {
+        parseCommandLine(vm);
+    }
+}
+
+void SettingsParser::parseCommandLine(const po::variables_map& vm)
+{
+    RelaySettings relay;
+    EndpointSettings destination;
+
+    relay.connectionTimeout = m_settings.m_connectionTimeout;
+
     if (vm.count("src-server") > 0)
-        m_settings.m_sourceServer = vm["src-server"].as<std::string>();
+        relay.source.server = vm["src-server"].as<std::string>();
 
     if (vm.count("src-mountpoint") > 0)
-        m_settings.m_sourceMountpoint = vm["src-mountpoint"].as<std::string>();
+        relay.source.mountpoint = vm["src-mountpoint"].as<std::string>();
 
     if (vm.count("src-login") > 0)
-        m_settings.m_sourceLogin = vm["src-login"].as<std::string>();
+        relay.source.login = vm["src-login"].as<std::string>();
 
     if (vm.count("src-password") > 0)
-        m_settings.m_sourcePassword = vm["src-password"].as<std::string>();
+        relay.source.password = vm["src-password"].as<std::string>();
 
     if (vm.count("src-port") > 0)
     {
         try
         {
-            m_settings.m_sourcePort = vm["src-port"].as<uint16_t>();
+            relay.source.port = vm["src-port"].as<uint16_t>();
         }
         catch (boost::bad_lexical_cast &)
         {
@@ -79,23 +325,50 @@ void SettingsParser::init(int argc, char* argv[])
         }
     }
 
+    if (vm.count("standby-server") > 0)
+        relay.standby.server = vm["standby-server"].as<std::string>();
+
+    if (vm.count("standby-mountpoint") > 0)
+        relay.standby.mountpoint = vm["standby-mountpoint"].as<std::string>();
+
+    if (vm.count("standby-login") > 0)
+        relay.standby.login = vm["standby-login"].as<std::string>();
+
+    if (vm.count("standby-password") > 0)
+        relay.standby.password = vm["standby-password"].as<std::string>();
+
+    if (vm.count("standby-port") > 0)
+        relay.standby.port = vm["standby-port"].as<uint16_t>();
+
+    if (vm.count("standby-silence") > 0)
+        relay.standbySilence = vm["standby-silence"].as<unsigned>();
+
     if (vm.count("dst-server") > 0)
-        m_settings.m_destinationServer = vm["dst-server"].as<std::string>();
+        destination.server = vm["dst-server"].as<std::string>();
 
     if (vm.count("dst-mountpoint") > 0)
-        m_settings.m_destinationMountpoint = vm["dst-mountpoint"].as<std::string>();
+        destination.mountpoint = vm["dst-mountpoint"].as<std::string>();
 
     if (vm.count("dst-login") > 0)
-        m_settings.m_destinationLogin = vm["dst-login"].as<std::string>();
+        destination.login = vm["dst-login"].as<std::string>();
 
     if (vm.count("dst-password") > 0)
-        m_settings.m_destinationPassword = vm["dst-password"].as<std::string>();
+        destination.password = vm["dst-password"].as<std::string>();
+
+    if (vm.count("dst-ntrip-version") > 0)
+        destination.ntripVersion = parseNtripVersion(vm["dst-ntrip-version"].as<unsigned>());
+
+    if (vm.count("src-tls") > 0)
+        relay.source.tls = vm["src-tls"].as<bool>();
+
+    if (vm.count("dst-tls") > 0)
+        destination.tls = vm["dst-tls"].as<bool>();
 
     if (vm.count("dst-port") > 0)
     {
         try
         {
-            m_settings.m_destinationPort = vm["dst-port"].as<uint16_t>();
+            destination.port = vm["dst-port"].as<uint16_t>();
         }
         catch (boost::bad_lexical_cast &)
         {
@@ -103,24 +376,124 @@ void SettingsParser::init(int argc, char* argv[])
         }
     }
 
-    if (vm.count("verbosity") > 0)
+    relay.source.socketProfile = parseSocketProfile(vm, "src-");
+    destination.socketProfile = parseSocketProfile(vm, "dst-");
+    relay.source.reconnect = parseReconnectPolicy(vm, "src-");
+    destination.reconnect = parseReconnectPolicy(vm, "dst-");
+
+    if (vm.count("gga") > 0)
+        relay.gga = vm["gga"].as<std::string>();
+
+    if (vm.count("queue-limit") > 0)
+        relay.queueLimit = vm["queue-limit"].as<size_t>();
+
+    if (vm.count("overflow-policy") > 0)
+        relay.overflowPolicy = parseOverflowPolicy(vm["overflow-policy"].as<std::string>());
+
+    // A configured queue means frames are to be inspected, which splicing
+    // bypasses.
+    if (vm.count("splice") > 0)
+        relay.splice = vm["splice"].as<bool>();
+    else
+        relay.splice = vm.count("queue-limit") == 0 && vm.count("overflow-policy") == 0;
+
+    if (relay.source.server.empty())
+        throw CasterError("You must specify source server location");
+
+    if (destination.server.empty())
+        throw CasterError("You must specify destination server location");
+
+    relay.destinations.push_back(destination);
+    m_settings.m_relays.push_back(relay);
+}
+
+void SettingsParser::parseConfigFile(const std::string& fileName)
+{
+    pt::ptree tree;
+    try
     {
-        m_settings.m_verbosity = vm["verbosity"].as<int>();
-        if (m_settings.m_verbosity < 1)
-        {
-            m_settings.m_verbosity = 0;
-        }
-        else if (m_settings.m_verbosity > 1)
-        {
-            m_settings.m_verbosity = 2;
-        }
+        pt::read_ini(fileName, tree);
+    }
+    catch (const pt::ini_parser_error& e)
+    {
+        throw CasterError("Failed to read config file: " + std::string(e.what()));
     }
 
-    if (vm.count("timeout") > 0)
-        m_settings.m_connectionTimeout = vm["timeout"].as<unsigned>();
+    // Sections sharing the same source are served by one relay, so the
+    // upstream caster sees a single connection for all of them.
+    std::map<std::string, size_t> sources;
+    for (const auto& section : tree)
+    {
+        if (section.second.empty())
+            throw CasterError("Config file option '" + section.first + "' is outside of a relay section");
 
-    if (vm.count("gga") > 0)
-        m_settings.m_gga = vm["gga"].as<std::string>();
+        RelaySettings relay(parseRelay(section.first, section.second));
+        const auto res = sources.emplace(sourceKey(relay), m_settings.m_relays.size());
+        if (res.second)
+            m_settings.m_relays.push_back(relay);
+        else
+            m_settings.m_relays[res.first->second].destinations.push_back(relay.destinations.front());
+    }
+
+    if (m_settings.m_relays.empty())
+        throw CasterError("Config file '" + fileName + "' defines no relays");
+}
+
+RelaySettings SettingsParser::parseRelay(const std::string& name,
+                                         const pt::ptree& section) const
+{
+    RelaySettings relay;
+    EndpointSettings destination;
+
+    relay.name = name;
+    try
+    {
+        relay.source.server = section.get<std::string>("src-server", "");
+        relay.source.port = section.get<uint16_t>("src-port", relay.source.port);
+        relay.source.mountpoint = section.get<std::string>("src-mountpoint", "");
+        relay.source.login = section.get<std::string>("src-login", "");
+        relay.source.password = section.get<std::string>("src-password", "");
+        relay.standby.server = section.get<std::string>("standby-server", "");
+        relay.standby.port = section.get<uint16_t>("standby-port", relay.standby.port);
+        relay.standby.mountpoint = section.get<std::string>("standby-mountpoint", "");
+        relay.standby.login = section.get<std::string>("standby-login", "");
+        relay.standby.password = section.get<std::string>("standby-password", "");
+        relay.standbySilence = section.get<unsigned>("standby-silence", relay.standbySilence);
+        destination.server = section.get<std::string>("dst-server", "");
+        destination.port = section.get<uint16_t>("dst-port", destination.port);
+        destination.mountpoint = section.get<std::string>("dst-mountpoint", "");
+        destination.login = section.get<std::string>("dst-login", "");
+        destination.password = section.get<std::string>("dst-password", "");
+        if (section.count("dst-ntrip-version") > 0)
+            destination.ntripVersion = parseNtripVersion(section.get<unsigned>("dst-ntrip-version"));
+        relay.source.socketProfile = parseSocketProfile(section, "src-");
+        destination.socketProfile = parseSocketProfile(section, "dst-");
+        relay.source.reconnect = parseReconnectPolicy(section, "src-");
+        destination.reconnect = parseReconnectPolicy(section, "dst-");
+        relay.source.tls = section.get<bool>("src-tls", false);
+        destination.tls = section.get<bool>("dst-tls", false);
+        relay.gga = section.get<std::string>("gga", "");
+        relay.connectionTimeout = section.get<unsigned>("timeout", m_settings.m_connectionTimeout);
+        relay.queueLimit = section.get<size_t>("queue-limit", relay.queueLimit);
+        if (section.count("overflow-policy") > 0)
+            relay.overflowPolicy = parseOverflowPolicy(section.get<std::string>("overflow-policy"));
+        relay.splice = section.get<bool>("splice",
+                                         section.count("queue-limit") == 0 &&
+                                         section.count("overflow-policy") == 0);
+    }
+    catch (const pt::ptree_error& e)
+    {
+        throw CasterError("Invalid value in relay '" + name + "': " + e.what());
+    }
+
+    if (relay.source.server.empty())
+        throw CasterError("Relay '" + name + "' has no source server location");
+
+    if (destination.server.empty())
+        throw CasterError("Relay '" + name + "' has no destination server location");
+
+    relay.destinations.push_back(destination);
+    return relay;
 }
 
 void SettingsParser::printHelp() const noexcept
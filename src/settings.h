@@ -1,9 +1,14 @@
 #ifndef __CASTER_SETTINGS_H__
 #define __CASTER_SETTINGS_H__
 
+#include "policies.h"
+#include "socket_profile.h"
+
 #include <boost/program_options.hpp>
+#include <boost/property_tree/ptree_fwd.hpp>
 
 #include <string>
+#include <vector>
 #include <cstdint>
 
 namespace po = boost::program_options;
@@ -11,6 +16,36 @@ namespace po = boost::program_options;
 namespace Caster
 {
 
+struct EndpointSettings
+{
+    std::string server;
+    uint16_t port = 2101;
+    std::string mountpoint;
+    std::string login;
+    std::string password;
+    SocketProfile socketProfile;
+    ReconnectPolicy reconnect;
+    bool tls = false;
+    // Only used for destinations.
+    NtripVersion ntripVersion = NtripVersion::v2;
+};
+
+struct RelaySettings
+{
+    std::string name;
+    EndpointSettings source;
+    // Hot standby source, none when the server is empty. It shares the
+    // socket profile, reconnect policy and TLS use of the source.
+    EndpointSettings standby;
+    unsigned standbySilence = 1500;
+    std::vector<EndpointSettings> destinations;
+    std::string gga;
+    unsigned connectionTimeout = 120;
+    size_t queueLimit = 64 * 1024;
+    OverflowPolicy overflowPolicy = OverflowPolicy::dropOldest;
+    bool splice = true;
+};
+
 class SettingsParser;
 class Settings
 {
@@ -21,42 +56,32 @@ class Settings
         bool isVersion() const noexcept { return m_isVersion; }
         bool isDebug() const noexcept { return m_isDebug; }
 
-        const std::string& sourceServer() const noexcept { return m_sourceServer; }
-        const std::string& sourceMountpoint() const noexcept { return m_sourceMountpoint; }
-        const std::string& sourceLogin() const noexcept { return m_sourceLogin; }
-        const std::string& sourcePassword() const noexcept { return m_sourcePassword; }
-
-        const std::string& destinationServer() const noexcept { return m_destinationServer; }
-        const std::string& destinationMountpoint() const noexcept { return m_destinationMountpoint; }
-        const std::string& destinationLogin() const noexcept { return m_destinationLogin; }
-        const std::string& destinationPassword() const noexcept { return m_destinationPassword; }
-
-        const std::string& gga() const noexcept { return m_gga; }
+        const std::string& configFile() const noexcept { return m_configFile; }
+        const std::vector<RelaySettings>& relays() const noexcept { return m_relays; }
 
         int verbosity() const noexcept { return m_verbosity; }
-        uint16_t destinationPort() const noexcept { return m_destinationPort; }
-        uint16_t sourcePort() const noexcept { return m_sourcePort; }
         unsigned connectionTimeout() const noexcept { return m_connectionTimeout; }
+        unsigned threads() const noexcept { return m_threads; }
+        unsigned shards() const noexcept { return m_shards; }
+        unsigned rebalanceInterval() const noexcept { return m_rebalanceInterval; }
+        bool tlsVerify() const noexcept { return m_tlsVerify; }
+        const std::string& tlsCaFile() const noexcept { return m_tlsCaFile; }
 
     private:
         bool m_isHelp;
         bool m_isVersion;
         bool m_isDebug;
 
-        std::string m_sourceServer;
-        std::string m_sourceMountpoint;
-        std::string m_sourceLogin;
-        std::string m_sourcePassword;
-        uint16_t m_sourcePort;
-        std::string m_destinationServer;
-        std::string m_destinationMountpoint;
-        std::string m_destinationLogin;
-        std::string m_destinationPassword;
-        uint16_t m_destinationPort;
-        std::string m_gga;
+        std::string m_configFile;
+        std::vector<RelaySettings> m_relays;
 
         int m_verbosity;
         unsigned m_connectionTimeout;
+        unsigned m_threads;
+        unsigned m_shards;
+        unsigned m_rebalanceInterval;
+        bool m_tlsVerify;
+        std::string m_tlsCaFile;
 
         friend class SettingsParser;
 };
@@ -73,6 +98,11 @@ class SettingsParser
     private:
         po::options_description m_desc;
         Settings m_settings;
+
+        void parseCommandLine(const po::variables_map& vm);
+        void parseConfigFile(const std::string& fileName);
+        RelaySettings parseRelay(const std::string& name,
+                                 const boost::property_tree::ptree& section) const;
 };
 
 }
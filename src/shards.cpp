@@ -0,0 +1,244 @@
+#include "shards.h"
+
+#include "logger.h"
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+
+#define ERRLOG(level) LOG(CerrWriter, level)
+
+using namespace MADF;
+using Caster::ShardPool;
+using Caster::RelayPtr;
+
+namespace pls = std::placeholders;
+namespace bs = boost::system;
+
+namespace
+{
+
+const size_t virtualNodes = 64;
+
+uint64_t fnv1a(const std::string& value)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (const char c : value)
+    {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+void pinThread(std::thread& thread, size_t cpu)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    const int res = pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+    if (res != 0)
+    {
+        ERRLOG(logWarning) << "Failed to pin shard thread to CPU " << cpu << ": " << strerror(res);
+    }
+}
+
+}
+
+ShardPool::ShardPool(size_t shards, const RelayFactory& factory)
+    : m_factory(factory),
+      m_timer(m_control),
+      m_interval(0)
+{
+    for (size_t i = 0; i < shards; ++i)
+    {
+        m_shards.push_back(std::make_unique<Shard>());
+        for (size_t v = 0; v < virtualNodes; ++v)
+            m_ring.emplace(fnv1a("shard-" + std::to_string(i) + "-" + std::to_string(v)), i);
+    }
+}
+
+ShardPool::~ShardPool()
+{
+    for (auto& shard : m_shards)
+        if (shard->thread.joinable())
+            shard->thread.join();
+}
+
+void ShardPool::add(const RelaySettings& settings)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_relays.emplace(settings.name, Entry{settings, RelayPtr(), locate(settings.source.mountpoint), 0});
+}
+
+void ShardPool::run(unsigned interval)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_relays.empty())
+            return;
+        for (auto& kv : m_relays)
+            kv.second.relay = spawn(kv.first, kv.second);
+    }
+
+    const size_t cpus = std::max(1u, std::thread::hardware_concurrency());
+    for (size_t i = 0; i < m_shards.size(); ++i)
+    {
+        Shard* shard = m_shards[i].get();
+        shard->thread = std::thread([shard]() { shard->ioService.run(); });
+        pinThread(shard->thread, i % cpus);
+    }
+
+    m_interval = interval;
+    scheduleRebalance();
+    m_control.run();
+
+    for (auto& shard : m_shards)
+        shard->thread.join();
+}
+
+void ShardPool::move(const std::string& name, size_t shard)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const auto it = m_relays.find(name);
+    if (it == m_relays.end() || shard >= m_shards.size())
+        return;
+    moveLocked(it->second, shard);
+}
+
+void ShardPool::rebalance()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::vector<uint64_t> load(m_shards.size(), 0);
+    std::vector<size_t> count(m_shards.size(), 0);
+    std::map<std::string, uint64_t> deltas;
+    for (auto& kv : m_relays)
+    {
+        Entry& entry = kv.second;
+        const uint64_t received = entry.relay->received();
+        const uint64_t delta = received - entry.lastReceived;
+        entry.lastReceived = received;
+        deltas[kv.first] = delta;
+        load[entry.shard] += delta;
+        ++count[entry.shard];
+    }
+
+    const size_t hot = std::max_element(load.begin(), load.end()) - load.begin();
+    const size_t cold = std::min_element(load.begin(), load.end()) - load.begin();
+    const uint64_t gap = load[hot] - load[cold];
+    // Only a shard carrying clearly more than its peers is worth the
+    // reconnect a move costs.
+    if (hot == cold || count[hot] < 2 || gap < load[hot] / 4)
+        return;
+
+    // Pick the relay whose move evens the two shards out best.
+    Entry* candidate = nullptr;
+    uint64_t best = gap;
+    for (auto& kv : m_relays)
+    {
+        const uint64_t delta = deltas[kv.first];
+        if (kv.second.shard != hot || delta == 0 || delta >= gap)
+            continue;
+        const uint64_t diff = gap > 2 * delta ? gap - 2 * delta : 2 * delta - gap;
+        if (diff < best)
+        {
+            best = diff;
+            candidate = &kv.second;
+        }
+    }
+
+    if (candidate)
+    {
+        ERRLOG(logInfo) << "Shard " << hot << " runs hot, moving relay "
+                        << candidate->settings.name << " to shard " << cold;
+        moveLocked(*candidate, cold);
+    }
+}
+
+size_t ShardPool::locate(const std::string& mountpoint) const
+{
+    auto it = m_ring.lower_bound(fnv1a(mountpoint));
+    if (it == m_ring.end())
+        it = m_ring.begin();
+    return it->second;
+}
+
+RelayPtr ShardPool::spawn(const std::string& name, Entry& entry)
+{
+    RelayPtr relay = m_factory(m_shards[entry.shard]->ioService, entry.settings);
+    relay->setStopCallback(std::bind(&ShardPool::handleStop, this, name, relay.get()));
+    relay->start(entry.settings.connectionTimeout);
+    entry.lastReceived = 0;
+    return relay;
+}
+
+void ShardPool::retire(const RelayPtr& relay, size_t shard)
+{
+    // Aborted operations still reference the connections of a stopped
+    // relay, keep it alive on its shard until they have completed.
+    auto timer = std::make_shared<boost::asio::steady_timer>(m_shards[shard]->ioService,
+                                                             std::chrono::seconds(1));
+    timer->async_wait([timer, relay](const bs::error_code&) {});
+}
+
+void ShardPool::moveLocked(Entry& entry, size_t shard)
+{
+    if (entry.shard == shard)
+        return;
+
+    RelayPtr old = entry.relay;
+    const size_t from = entry.shard;
+
+    // The replaced relay is no longer in the table, so its stop callback
+    // is ignored.
+    old->stop();
+    retire(old, from);
+
+    entry.shard = shard;
+    entry.relay = spawn(entry.settings.name, entry);
+}
+
+void ShardPool::handleStop(const std::string& name, const Relay* relay)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const auto it = m_relays.find(name);
+    if (it == m_relays.end() || it->second.relay.get() != relay)
+        return;
+
+    retire(it->second.relay, it->second.shard);
+    m_relays.erase(it);
+    if (m_relays.empty())
+        finish();
+}
+
+void ShardPool::scheduleRebalance()
+{
+    if (m_interval == 0)
+        return;
+    m_timer.expires_from_now(std::chrono::seconds(m_interval));
+    m_timer.async_wait(std::bind(&ShardPool::handleRebalance, this, pls::_1));
+}
+
+void ShardPool::handleRebalance(const bs::error_code& ec)
+{
+    if (ec == boost::asio::error::operation_aborted)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_relays.empty())
+            return;
+    }
+    rebalance();
+    scheduleRebalance();
+}
+
+void ShardPool::finish()
+{
+    for (auto& shard : m_shards)
+        shard->guard.reset();
+    boost::asio::post(m_control, [this]() { m_timer.cancel(); });
+}
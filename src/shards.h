@@ -0,0 +1,87 @@
+#ifndef __CASTER_SHARDS_H__
+#define __CASTER_SHARDS_H__
+
+#include "relay.h"
+#include "settings.h"
+
+#include <boost/asio.hpp>
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <functional>
+#include <cstdint>
+
+namespace Caster {
+
+using RelayFactory = std::function<RelayPtr (boost::asio::io_service&, const RelaySettings&)>;
+
+// Share-nothing execution: every shard has its own io_service served by a
+// single thread pinned to one CPU, so a relay's data, timers and logging
+// stay on that core. Relays are placed by a consistent hash of their
+// source mountpoint and can later be moved to another shard.
+class ShardPool
+{
+    public:
+        ShardPool(size_t shards, const RelayFactory& factory);
+        ~ShardPool();
+
+        ShardPool(const ShardPool&) = delete;
+        ShardPool& operator=(const ShardPool&) = delete;
+
+        void add(const RelaySettings& settings);
+
+        // Starts the relays and blocks until all of them have stopped.
+        // Shard load is rebalanced every `interval` seconds, 0 disables it.
+        void run(unsigned interval);
+
+        void move(const std::string& name, size_t shard);
+        void rebalance();
+
+        size_t shards() const { return m_shards.size(); }
+
+    private:
+        using WorkGuard = boost::asio::executor_work_guard<boost::asio::io_service::executor_type>;
+
+        struct Shard
+        {
+            Shard() : guard(ioService.get_executor()) {}
+
+            boost::asio::io_service ioService;
+            WorkGuard guard;
+            std::thread thread;
+        };
+
+        struct Entry
+        {
+            RelaySettings settings;
+            RelayPtr relay;
+            size_t shard;
+            uint64_t lastReceived;
+        };
+
+        std::vector<std::unique_ptr<Shard>> m_shards;
+        std::map<uint64_t, size_t> m_ring;
+        std::map<std::string, Entry> m_relays;
+        RelayFactory m_factory;
+        std::mutex m_mutex;
+        boost::asio::io_service m_control;
+        boost::asio::steady_timer m_timer;
+        unsigned m_interval;
+
+        size_t locate(const std::string& mountpoint) const;
+        RelayPtr spawn(const std::string& name, Entry& entry);
+        void retire(const RelayPtr& relay, size_t shard);
+        void moveLocked(Entry& entry, size_t shard);
+        void handleStop(const std::string& name, const Relay* relay);
+        void scheduleRebalance();
+        void handleRebalance(const boost::system::error_code& ec);
+        void finish();
+};
+
+}
+
+#endif
@@ -0,0 +1,52 @@
+#include "socket_profile.h"
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include <cerrno>
+
+namespace bs = boost::system;
+
+namespace
+{
+
+void setOption(int fd, int level, int name, int value, bs::error_code& ec)
+{
+    if (ec)
+        return;
+    if (setsockopt(fd, level, name, &value, sizeof(value)) != 0)
+        ec = bs::error_code(errno, bs::system_category());
+}
+
+}
+
+void Caster::applySocketProfile(boost::asio::ip::tcp::socket::native_handle_type fd,
+                                const SocketProfile& profile,
+                                bs::error_code& ec)
+{
+    ec = bs::error_code();
+
+    if (profile.noDelay)
+        setOption(fd, IPPROTO_TCP, TCP_NODELAY, *profile.noDelay ? 1 : 0, ec);
+    if (profile.sendBuffer)
+        setOption(fd, SOL_SOCKET, SO_SNDBUF, static_cast<int>(*profile.sendBuffer), ec);
+    if (profile.receiveBuffer)
+        setOption(fd, SOL_SOCKET, SO_RCVBUF, static_cast<int>(*profile.receiveBuffer), ec);
+#ifdef TCP_NOTSENT_LOWAT
+    if (profile.notSentLowat)
+        setOption(fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, static_cast<int>(*profile.notSentLowat), ec);
+#endif
+#ifdef TCP_USER_TIMEOUT
+    if (profile.userTimeout)
+        setOption(fd, IPPROTO_TCP, TCP_USER_TIMEOUT, static_cast<int>(*profile.userTimeout), ec);
+#endif
+    if (profile.keepAliveIdle || profile.keepAliveInterval || profile.keepAliveCount)
+        setOption(fd, SOL_SOCKET, SO_KEEPALIVE, 1, ec);
+    if (profile.keepAliveIdle)
+        setOption(fd, IPPROTO_TCP, TCP_KEEPIDLE, static_cast<int>(*profile.keepAliveIdle), ec);
+    if (profile.keepAliveInterval)
+        setOption(fd, IPPROTO_TCP, TCP_KEEPINTVL, static_cast<int>(*profile.keepAliveInterval), ec);
+    if (profile.keepAliveCount)
+        setOption(fd, IPPROTO_TCP, TCP_KEEPCNT, static_cast<int>(*profile.keepAliveCount), ec);
+}
@@ -0,0 +1,37 @@
+#ifndef __CASTER_SOCKET_PROFILE_H__
+#define __CASTER_SOCKET_PROFILE_H__
+
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/system/error_code.hpp>
+
+#include <optional>
+
+namespace Caster {
+
+// Socket options applied to a connection right after it is established.
+// Unset options keep the kernel defaults.
+struct SocketProfile
+{
+    std::optional<bool> noDelay;
+    std::optional<unsigned> sendBuffer;          // bytes
+    std::optional<unsigned> receiveBuffer;       // bytes
+    std::optional<unsigned> notSentLowat;        // bytes
+    std::optional<unsigned> userTimeout;         // milliseconds
+    std::optional<unsigned> keepAliveIdle;       // seconds
+    std::optional<unsigned> keepAliveInterval;   // seconds
+    std::optional<unsigned> keepAliveCount;
+
+    bool empty() const
+    {
+        return !noDelay && !sendBuffer && !receiveBuffer && !notSentLowat &&
+               !userTimeout && !keepAliveIdle && !keepAliveInterval && !keepAliveCount;
+    }
+};
+
+void applySocketProfile(boost::asio::ip::tcp::socket::native_handle_type fd,
+                        const SocketProfile& profile,
+                        boost::system::error_code& ec);
+
+}
+
+#endif
@@ -0,0 +1,245 @@
+#include "splicer.h"
+
+#include "utils.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+
+using Caster::Splicer;
+
+namespace pls = std::placeholders;
+namespace bs = boost::system;
+namespace ba = boost::asio;
+
+namespace
+{
+
+const unsigned spliceFlags = SPLICE_F_MOVE | SPLICE_F_NONBLOCK;
+
+bs::error_code lastError()
+{
+    return bs::error_code(errno, bs::system_category());
+}
+
+bool wouldBlock()
+{
+    return errno == EAGAIN || errno == EINTR;
+}
+
+}
+
+Splicer::Splicer(Connection::Socket& source, Connection::Socket& destination)
+    : m_source(source),
+      m_destination(destination),
+      m_inputBytes(0),
+      m_outputBytes(0),
+      m_trailerPending(false),
+      m_chunked(true),
+      m_generation(0)
+{
+}
+
+Splicer::~Splicer()
+{
+    closePipes();
+}
+
+void Splicer::open(bs::error_code& ec)
+{
+    stop();
+    m_inputBytes = 0;
+    m_outputBytes = 0;
+    m_trailerPending = false;
+
+    int fds[2];
+    if (pipe2(fds, O_NONBLOCK | O_CLOEXEC) != 0)
+    {
+        ec = lastError();
+        return;
+    }
+    m_input.read = fds[0];
+    m_input.write = fds[1];
+
+    if (pipe2(fds, O_NONBLOCK | O_CLOEXEC) != 0)
+    {
+        ec = lastError();
+        closePipes();
+        return;
+    }
+    m_output.read = fds[0];
+    m_output.write = fds[1];
+
+    m_source.non_blocking(true, ec);
+    if (!ec)
+        m_destination.non_blocking(true, ec);
+    if (ec)
+        closePipes();
+}
+
+void Splicer::start()
+{
+    if (m_input.read >= 0)
+        waitSource();
+}
+
+void Splicer::stop()
+{
+    // Readiness of the sockets may already be queued, it must not touch
+    // the pipes of a later session.
+    ++m_generation;
+    closePipes();
+}
+
+void Splicer::waitSource()
+{
+    m_source.async_wait(Connection::Socket::wait_read,
+                        std::bind(&Splicer::handleSourceReady, this, m_generation, pls::_1));
+}
+
+void Splicer::handleSourceReady(unsigned generation, const bs::error_code& error)
+{
+    if (error == ba::error::operation_aborted || generation != m_generation)
+        return;
+    if (error)
+    {
+        fail(error);
+        return;
+    }
+
+    const ssize_t size = splice(m_source.native_handle(), nullptr,
+                                m_input.write, nullptr,
+                                maxChunk, spliceFlags);
+    if (size < 0)
+    {
+        if (wouldBlock())
+            waitSource();
+        else
+            fail(lastError());
+        return;
+    }
+    if (size == 0)
+    {
+        if (m_eofCallback)
+            m_eofCallback();
+        return;
+    }
+
+    if (m_splicedCallback)
+        m_splicedCallback(static_cast<size_t>(size));
+
+    if (!m_chunked)
+    {
+        m_outputBytes = static_cast<size_t>(size);
+        transfer();
+        return;
+    }
+
+    m_inputBytes = static_cast<size_t>(size);
+
+    // The output pipe is drained before the source is read again, so the
+    // size line always fits.
+    char header[2 * sizeof(size_t) + 2];
+    const size_t headerSize = formatChunkHeader(header, m_inputBytes);
+    if (write(m_output.write, header, headerSize) != static_cast<ssize_t>(headerSize))
+    {
+        fail(lastError());
+        return;
+    }
+    m_outputBytes = headerSize;
+    m_trailerPending = true;
+
+    transfer();
+}
+
+void Splicer::handleDestinationReady(unsigned generation, const bs::error_code& error)
+{
+    if (error == ba::error::operation_aborted || generation != m_generation)
+        return;
+    if (error)
+    {
+        fail(error);
+        return;
+    }
+
+    transfer();
+}
+
+void Splicer::transfer()
+{
+    for (;;)
+    {
+        if (m_inputBytes > 0)
+        {
+            const ssize_t size = splice(m_input.read, nullptr,
+                                        m_output.write, nullptr,
+                                        m_inputBytes, spliceFlags);
+            if (size > 0)
+            {
+                m_inputBytes -= static_cast<size_t>(size);
+                m_outputBytes += static_cast<size_t>(size);
+            }
+            else if (size < 0 && !wouldBlock())
+            {
+                fail(lastError());
+                return;
+            }
+        }
+
+        if (m_inputBytes == 0 && m_trailerPending)
+        {
+            const ssize_t size = write(m_output.write, "\r\n", 2);
+            if (size == 2)
+            {
+                m_trailerPending = false;
+                m_outputBytes += 2;
+            }
+            else if (size < 0 && !wouldBlock())
+            {
+                fail(lastError());
+                return;
+            }
+        }
+
+        if (m_outputBytes == 0)
+        {
+            if (m_inputBytes == 0 && !m_trailerPending)
+            {
+                waitSource();
+                return;
+            }
+            continue;
+        }
+
+        const ssize_t size = splice(m_chunked ? m_output.read : m_input.read, nullptr,
+                                    m_destination.native_handle(), nullptr,
+                                    m_outputBytes, spliceFlags);
+        if (size < 0)
+        {
+            if (wouldBlock())
+                m_destination.async_wait(Connection::Socket::wait_write,
+                                         std::bind(&Splicer::handleDestinationReady, this, m_generation, pls::_1));
+            else
+                fail(lastError());
+            return;
+        }
+        m_outputBytes -= static_cast<size_t>(size);
+    }
+}
+
+void Splicer::fail(const bs::error_code& ec)
+{
+    if (m_errorCallback)
+        m_errorCallback(ec);
+}
+
+void Splicer::closePipes()
+{
+    for (int* fd : {&m_input.read, &m_input.write, &m_output.read, &m_output.write})
+    {
+        if (*fd >= 0)
+            close(*fd);
+        *fd = -1;
+    }
+}
@@ -0,0 +1,72 @@
+#ifndef __CASTER_SPLICER_H__
+#define __CASTER_SPLICER_H__
+
+#include "callbacks.h"
+#include "connection.h"
+
+#include <boost/system/error_code.hpp>
+
+#include <cstddef>
+
+namespace Caster {
+
+// Moves payload from the source socket to the destination socket with
+// splice() through two pipes, so the bytes never enter user space. The
+// first pipe takes what the source socket has, the second one gets it
+// wrapped into a chunk of the destination's transfer encoding. Unchunked
+// destinations are fed from the first pipe directly.
+class Splicer
+{
+    public:
+        Splicer(Connection::Socket& source, Connection::Socket& destination);
+        ~Splicer();
+
+        Splicer(const Splicer&) = delete;
+        Splicer& operator=(const Splicer&) = delete;
+
+        // May be opened again after stop(), once both sockets reconnected.
+        void open(boost::system::error_code& ec);
+        void start();
+        void stop();
+
+        void setChunked(bool chunked) { m_chunked = chunked; }
+
+        void setErrorCallback(const ErrorCallback& cb) { m_errorCallback = cb; }
+        void setEOFCallback(const EOFCallback& cb) { m_eofCallback = cb; }
+        void setSplicedCallback(const SplicedCallback& cb) { m_splicedCallback = cb; }
+
+    private:
+        struct Pipe
+        {
+            int read = -1;
+            int write = -1;
+        };
+
+        static const size_t maxChunk = 16 * 1024;
+
+        Connection::Socket& m_source;
+        Connection::Socket& m_destination;
+        Pipe m_input;
+        Pipe m_output;
+        size_t m_inputBytes;
+        size_t m_outputBytes;
+        bool m_trailerPending;
+        bool m_chunked;
+        unsigned m_generation;
+        ErrorCallback m_errorCallback;
+        EOFCallback m_eofCallback;
+        SplicedCallback m_splicedCallback;
+
+        void waitSource();
+        void handleSourceReady(unsigned generation,
+                               const boost::system::error_code& error);
+        void handleDestinationReady(unsigned generation,
+                                    const boost::system::error_code& error);
+        void transfer();
+        void fail(const boost::system::error_code& ec);
+        void closePipes();
+};
+
+}
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef __CASTER_STRAND_H__
+#define __CASTER_STRAND_H__
+
+#include <boost/asio.hpp>
+
+#include <chrono>
+
+namespace Caster {
+
+// All handlers of a relay run on one strand, so the relay and its
+// connections never need locking even when io_service runs on a pool.
+using Strand = boost::asio::strand<boost::asio::io_service::executor_type>;
+
+// Bound to the concrete strand type rather than any_io_executor, so
+// starting an operation does not allocate a type-erased executor.
+using StrandSocket = boost::asio::basic_stream_socket<boost::asio::ip::tcp, Strand>;
+using StrandTimer = boost::asio::basic_waitable_timer<std::chrono::steady_clock,
+                                                      boost::asio::wait_traits<std::chrono::steady_clock>,
+                                                      Strand>;
+
+}
+
+#endif
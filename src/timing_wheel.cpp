@@ -0,0 +1,133 @@
+#include "timing_wheel.h"
+
+#include <algorithm>
+#include <chrono>
+
+using Caster::TimingWheel;
+
+namespace pls = std::placeholders;
+
+boost::asio::execution_context::id TimingWheel::id;
+
+TimingWheel::Entry::Entry(const std::atomic<uint64_t>& clock, const Strand& strand,
+                          unsigned timeout, const Handler& handler)
+    : m_clock(clock),
+      m_strand(strand),
+      // The tick an entry is touched in may be nearly over.
+      m_timeout(timeout + 1),
+      m_handler(handler),
+      m_lastActivity(0),
+      m_cancelled(false),
+      m_slot(0)
+{
+    touch();
+}
+
+TimingWheel::TimingWheel(boost::asio::execution_context& context)
+    : boost::asio::execution_context::service(context),
+      m_clock(0),
+      m_entries(0),
+      m_ticking(false),
+      m_shutdown(false)
+{
+}
+
+TimingWheel::EntryPtr TimingWheel::schedule(const Strand& strand, unsigned timeout,
+                                            const Handler& handler)
+{
+    auto entry = std::make_shared<Entry>(m_clock, strand, timeout, handler);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_shutdown)
+        return entry;
+    if (!m_timer)
+        m_timer = std::make_unique<boost::asio::steady_timer>(strand.get_inner_executor());
+    insert(entry);
+    ++m_entries;
+    if (!m_ticking)
+        arm();
+    return entry;
+}
+
+void TimingWheel::cancel(const EntryPtr& entry)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (entry->m_cancelled.exchange(true, std::memory_order_relaxed))
+        return;
+
+    auto& slot = m_wheel[entry->m_slot];
+    const auto it = std::find(slot.begin(), slot.end(), entry);
+    if (it == slot.end())
+        return; // already expired
+    *it = std::move(slot.back());
+    slot.pop_back();
+
+    // An idle wheel must not keep io_service::run() busy.
+    if (--m_entries == 0 && m_ticking)
+    {
+        m_ticking = false;
+        m_timer->cancel();
+    }
+}
+
+void TimingWheel::shutdown()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_shutdown = true;
+    m_timer.reset();
+    for (auto& slot : m_wheel)
+        slot.clear();
+    m_entries = 0;
+}
+
+void TimingWheel::insert(const EntryPtr& entry)
+{
+    entry->m_slot = entry->deadline() % slots;
+    m_wheel[entry->m_slot].push_back(entry);
+}
+
+void TimingWheel::arm()
+{
+    m_ticking = true;
+    m_timer->expires_after(std::chrono::seconds(1));
+    m_timer->async_wait(std::bind(&TimingWheel::handleTick, this, pls::_1));
+}
+
+void TimingWheel::handleTick(const boost::system::error_code& error)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (error == boost::asio::error::operation_aborted || m_shutdown || !m_ticking)
+        return;
+
+    const uint64_t now = m_clock.fetch_add(1, std::memory_order_relaxed) + 1;
+    auto& slot = m_wheel[now % slots];
+    size_t kept = 0;
+    for (auto& entry : slot)
+    {
+        const uint64_t deadline = entry->deadline();
+        if (deadline <= now)
+        {
+            --m_entries;
+            boost::asio::post(entry->m_strand, [entry]() {
+                if (!entry->m_cancelled.exchange(true, std::memory_order_relaxed))
+                    entry->m_handler();
+            });
+        }
+        else if (deadline % slots == now % slots)
+        {
+            slot[kept++] = std::move(entry);
+        }
+        else
+        {
+            // Touched since it was put here, wait for the new deadline.
+            entry->m_slot = deadline % slots;
+            m_wheel[entry->m_slot].push_back(std::move(entry));
+        }
+    }
+    slot.resize(kept);
+
+    if (m_entries > 0)
+        arm();
+    else
+        m_ticking = false;
+}
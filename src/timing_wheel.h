@@ -0,0 +1,84 @@
+#ifndef __CASTER_TIMING_WHEEL_H__
+#define __CASTER_TIMING_WHEEL_H__
+
+#include "strand.h"
+
+#include <boost/asio.hpp>
+
+#include <array>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <cstdint>
+
+namespace Caster {
+
+// Hashed timing wheel shared by all connections of an io_service, obtained
+// with boost::asio::use_service<TimingWheel>(). A connection only stores
+// the current coarse tick on activity, so keeping a timeout alive costs an
+// atomic store per read or write instead of re-arming an Asio timer. A
+// single one second tick visits one slot and expires the idle entries in
+// it; active ones are moved to the slot of their new deadline.
+class TimingWheel : public boost::asio::execution_context::service
+{
+    public:
+        using Handler = std::function<void ()>;
+
+        class Entry
+        {
+            public:
+                Entry(const std::atomic<uint64_t>& clock, const Strand& strand,
+                      unsigned timeout, const Handler& handler);
+
+                void touch() { m_lastActivity.store(m_clock.load(std::memory_order_relaxed), std::memory_order_relaxed); }
+
+            private:
+                const std::atomic<uint64_t>& m_clock;
+                Strand m_strand;
+                uint64_t m_timeout;
+                Handler m_handler;
+                std::atomic<uint64_t> m_lastActivity;
+                std::atomic<bool> m_cancelled;
+                size_t m_slot;
+
+                uint64_t deadline() const { return m_lastActivity.load(std::memory_order_relaxed) + m_timeout; }
+
+                friend class TimingWheel;
+        };
+
+        using EntryPtr = std::shared_ptr<Entry>;
+
+        static boost::asio::execution_context::id id;
+
+        explicit TimingWheel(boost::asio::execution_context& context);
+
+        // The handler is posted to the strand once the entry was not touched
+        // for `timeout` seconds, unless it was cancelled before.
+        EntryPtr schedule(const Strand& strand, unsigned timeout, const Handler& handler);
+        // Must be called on the strand of the entry, so its handler can not
+        // run afterwards.
+        void cancel(const EntryPtr& entry);
+
+    private:
+        static const size_t slots = 256;
+
+        std::mutex m_mutex;
+        std::atomic<uint64_t> m_clock;
+        std::array<std::vector<EntryPtr>, slots> m_wheel;
+        std::unique_ptr<boost::asio::steady_timer> m_timer;
+        size_t m_entries;
+        bool m_ticking;
+        bool m_shutdown;
+
+        void shutdown() override;
+
+        void insert(const EntryPtr& entry);
+        void arm();
+        void handleTick(const boost::system::error_code& error);
+};
+
+}
+
+#endif
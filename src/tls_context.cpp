@@ -0,0 +1,95 @@
+#include "tls_context.h"
+
+#include "logger.h"
+
+#define ERRLOG(level) LOG(CerrWriter, level)
+
+using namespace MADF;
+using Caster::TlsContext;
+
+namespace bs = boost::system;
+namespace ba = boost::asio;
+
+TlsContext& TlsContext::getInstance()
+{
+    static TlsContext context;
+    return context;
+}
+
+TlsContext::TlsContext()
+    : m_context(ba::ssl::context::tls_client),
+      m_keyIndex(SSL_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr)),
+      m_verify(true)
+{
+    SSL_CTX* ctx = m_context.native_handle();
+    SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+    // Sessions are only stored by handleNewSession(), OpenSSL's own client
+    // cache is never looked up.
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(ctx, &TlsContext::handleNewSession);
+
+    bs::error_code ec;
+    m_context.set_default_verify_paths(ec);
+    if (ec)
+    {
+        ERRLOG(logWarning) << "Failed to load the default CA certificates: " << ec.message();
+    }
+}
+
+TlsContext::~TlsContext()
+{
+    for (auto& entry : m_sessions)
+    {
+        if (entry.second)
+            SSL_SESSION_free(entry.second);
+    }
+}
+
+void TlsContext::loadCaFile(const std::string& file)
+{
+    m_context.load_verify_file(file);
+}
+
+void TlsContext::prepare(TlsStream& stream, const std::string& host, uint16_t port)
+{
+    SSL* ssl = stream.native_handle();
+
+    // Address literals are not sent as a server name. SSL_set_tlsext_host_name()
+    // is a macro with a C cast.
+    bs::error_code ec;
+    ba::ip::make_address(host, ec);
+    if (ec)
+        SSL_ctrl(ssl, SSL_CTRL_SET_TLSEXT_HOSTNAME, TLSEXT_NAMETYPE_host_name, const_cast<char*>(host.c_str()));
+
+    if (m_verify)
+    {
+        stream.set_verify_mode(ba::ssl::verify_peer);
+        stream.set_verify_callback(ba::ssl::host_name_verification(host));
+    }
+    else
+    {
+        stream.set_verify_mode(ba::ssl::verify_none);
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const auto entry = m_sessions.emplace(host + ":" + std::to_string(port), nullptr).first;
+    SSL_set_ex_data(ssl, m_keyIndex, const_cast<std::string*>(&entry->first));
+    if (entry->second)
+        SSL_set_session(ssl, entry->second);
+}
+
+int TlsContext::handleNewSession(SSL* ssl, SSL_SESSION* session)
+{
+    TlsContext& self = getInstance();
+    const auto* key = static_cast<const std::string*>(SSL_get_ex_data(ssl, self.m_keyIndex));
+    if (!key)
+        return 0;
+
+    // The last session wins, a TLS 1.3 server may send several tickets.
+    std::lock_guard<std::mutex> lock(self.m_mutex);
+    SSL_SESSION*& cached = self.m_sessions[*key];
+    if (cached)
+        SSL_SESSION_free(cached);
+    cached = session;
+    return 1;
+}
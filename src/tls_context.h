@@ -0,0 +1,54 @@
+#ifndef __CASTER_TLS_CONTEXT_H__
+#define __CASTER_TLS_CONTEXT_H__
+
+#include "strand.h"
+
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <cstdint>
+
+namespace Caster {
+
+using TlsStream = boost::asio::ssl::stream<StrandSocket&>;
+
+// Process wide client TLS context. Sessions, including the TLS 1.3 tickets
+// a server sends after the handshake, are kept per host and port and
+// offered on the next connection, so a reconnect resumes instead of going
+// through a full handshake.
+class TlsContext
+{
+    public:
+        static TlsContext& getInstance();
+
+        boost::asio::ssl::context& context() { return m_context; }
+
+        // Both must be called before the first connection.
+        void setVerify(bool verify) { m_verify = verify; }
+        void loadCaFile(const std::string& file);
+
+        // Sets up server name indication, peer verification and the
+        // session to resume for a new connection to host and port.
+        void prepare(TlsStream& stream, const std::string& host, uint16_t port);
+
+    private:
+        std::mutex m_mutex;
+        // Entries are never erased, so keys stay valid for the ex_data of
+        // the SSL objects pointing at them.
+        std::map<std::string, SSL_SESSION*> m_sessions;
+        boost::asio::ssl::context m_context;
+        int m_keyIndex;
+        bool m_verify;
+
+        TlsContext();
+        ~TlsContext();
+
+        static int handleNewSession(SSL* ssl, SSL_SESSION* session);
+};
+
+}
+
+#endif
@@ -1,28 +1,27 @@
 #ifndef __CASTER_UTILS_H__
 #define __CASTER_UTILS_H__
 
-#include <boost/asio/buffer.hpp>
-#include <boost/spirit/include/qi.hpp>
-#include <boost/phoenix.hpp>
-
-#include <algorithm>
+#include <cstddef>
 
 namespace Caster {
 
+// Writes the hex size line of a chunk, at most 2 * sizeof(size_t) + 2 bytes.
 inline
-size_t parseChunkLength(const boost::asio::const_buffers_1& buffers,
-                        size_t& length)
+size_t formatChunkHeader(char* header, size_t size)
 {
-    namespace phoenix = boost::phoenix;
-    namespace qi = boost::spirit::qi;
-
-    const char* const begin = boost::asio::buffer_cast<const char*>(*buffers.begin());
-    const char* iter = begin;
-    const char* const end(begin + boost::asio::buffer_size(*buffers.begin()));
-
-    qi::parse(iter, end, (qi::hex[phoenix::ref(length) = qi::_1] >> *(qi::char_-'\r') > "\r\n"));
-
-    return std::distance(begin, iter);
+    static const char digits[] = "0123456789abcdef";
+    char hex[2 * sizeof(size_t)];
+    size_t length = 0;
+    do {
+        hex[length++] = digits[size & 0xF];
+        size >>= 4;
+    } while (size > 0);
+
+    for (size_t i = 0; i < length; ++i)
+        header[i] = hex[length - 1 - i];
+    header[length++] = '\r';
+    header[length++] = '\n';
+    return length;
 }
 
 }